@@ -36,6 +36,7 @@
 #include "clock.h"
 #include "alce-math.h"
 #include "home.h"
+#include "mission.h"
 #include "flight_stats.h"
 #include "fonts.h"
 #include "adc.h"
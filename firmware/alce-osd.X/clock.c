@@ -155,6 +155,18 @@ void remove_timers(unsigned char ctype)
     }
 }
 
+void remove_timers_data(unsigned char ctype, void *data)
+{
+    struct timer *t = timers;
+    unsigned char i;
+
+    for (i = 0; i < nr_timers; i++) {
+        if ((t->type == ctype) && (t->data == data))
+            t->cbk = NULL;
+        t++;
+    }
+}
+
 static void clock_process(void)
 {
     static unsigned char i = 0;
@@ -30,6 +30,7 @@ void clock_init(void);
 struct timer* add_timer(unsigned char type, unsigned long period, void *cbk, void *data);
 inline void remove_timer(struct timer *t);
 void remove_timers(unsigned char type);
+void remove_timers_data(unsigned char type, void *data);
 inline void set_timer_period(struct timer *t, unsigned long period);
 unsigned long get_micros(void);
 void shell_cmd_clock(char *args, void *data);
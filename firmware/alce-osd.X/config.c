@@ -30,7 +30,7 @@
 #define CONFIG_ADDR_PAGE    (0x800)
 #define CONFIG_PAGE_SIZE    (0x400)
 
-#define CONFIG_VERSION_SIG  (0xffffff-12)
+#define CONFIG_VERSION_SIG  (0xffffff-17)
 
 //#define DEBUG_CONFIG
 
@@ -88,6 +88,9 @@ struct alceosd_config config = {
         .osd_sysid = 200,
         .uav_sysid = 1,
         .heartbeat = 1,
+        .dedup = MAVLINK_DEDUP_OFF,
+        .param_load = 80,
+        .mission_poll = 30,
     },
     
     .rssi = {
@@ -108,30 +111,30 @@ struct alceosd_config config = {
     .default_units = UNITS_METRIC,
 
     .widgets = {
-        { 1, 0, WIDGET_ALTITUDE_ID,        0,   0, {JUST_VCENTER | JUST_RIGHT}},
-        { 1, 0, WIDGET_BATTERY_INFO_ID,    0,   0, {JUST_TOP     | JUST_LEFT}},
-        { 1, 0, WIDGET_COMPASS_ID,         0,   0, {JUST_BOT     | JUST_HCENTER}},
-        { 1, 0, WIDGET_FLIGHT_MODE_ID,     0, -32, {JUST_BOT     | JUST_LEFT}},
-        { 1, 0, WIDGET_GPS_INFO_ID,        0,   0, {JUST_BOT     | JUST_LEFT}},
-//        { 1, 0, WIDGET_ILS_ID,             0,   0, {JUST_VCENTER | JUST_HCENTER}},
-        { 1, 0, WIDGET_HORIZON_ID,        16,   0, {JUST_VCENTER | JUST_HCENTER}},
-        { 1, 0, WIDGET_RSSI_ID,            0,   0, {JUST_TOP     | JUST_RIGHT}, {0, 255}},
-        { 1, 0, WIDGET_SPEED_ID,           0,   0, {JUST_VCENTER | JUST_LEFT}},
-        { 1, 0, WIDGET_THROTTLE_ID,       70,   0, {JUST_TOP     | JUST_LEFT}},
-        { 1, 0, WIDGET_VARIOMETER_ID,      0,  -5, {JUST_BOT     | JUST_RIGHT}},
-        { 1, 0, WIDGET_WIND_ID,            0,  30, {JUST_TOP     | JUST_RIGHT}},
-
-        { 1, 0, WIDGET_HOME_INFO_ID,      88,   0, {JUST_TOP     | JUST_LEFT}},
-        { 1, 0, WIDGET_RADAR_ID,          60, -44, {JUST_BOT     | JUST_LEFT}},
-        { 1, 0, WIDGET_ALARMS_ID,          0,   0, {JUST_TOP     | JUST_HCENTER}},
-
-        { 2, 0, WIDGET_RC_CHANNELS_ID,     0,   0, {JUST_TOP     | JUST_LEFT}},
-        { 2, 1, WIDGET_RADAR_ID,           0,   0, {JUST_TOP     | JUST_HCENTER}},
-        { 2, 0, WIDGET_CONSOLE_ID,         0,   0, {JUST_BOT     | JUST_LEFT}},
-
-        { 3, 0, WIDGET_FLIGHT_INFO_ID,     0,   0, {JUST_VCENTER | JUST_HCENTER}},
-
-        { TABS_END, 0, 0, 0, 0, {0}},
+        { 1, 0, WIDGET_ALTITUDE_ID,      0,    0,   0, {JUST_VCENTER | JUST_RIGHT}},
+        { 1, 0, WIDGET_BATTERY_INFO_ID,  0,    0,   0, {JUST_TOP     | JUST_LEFT}},
+        { 1, 0, WIDGET_COMPASS_ID,       0,    0,   0, {JUST_BOT     | JUST_HCENTER}},
+        { 1, 0, WIDGET_FLIGHT_MODE_ID,   0,    0, -32, {JUST_BOT     | JUST_LEFT}},
+        { 1, 0, WIDGET_GPS_INFO_ID,      0,    0,   0, {JUST_BOT     | JUST_LEFT}},
+//        { 1, 0, WIDGET_ILS_ID,           0,    0,   0, {JUST_VCENTER | JUST_HCENTER}},
+        { 1, 0, WIDGET_HORIZON_ID,       0,   16,   0, {JUST_VCENTER | JUST_HCENTER}},
+        { 1, 0, WIDGET_RSSI_ID,          0,    0,   0, {JUST_TOP     | JUST_RIGHT}, {0, 255}},
+        { 1, 0, WIDGET_SPEED_ID,         0,    0,   0, {JUST_VCENTER | JUST_LEFT}},
+        { 1, 0, WIDGET_THROTTLE_ID,      0,   70,   0, {JUST_TOP     | JUST_LEFT}},
+        { 1, 0, WIDGET_VARIOMETER_ID,    0,    0,  -5, {JUST_BOT     | JUST_RIGHT}},
+        { 1, 0, WIDGET_WIND_ID,          0,    0,  30, {JUST_TOP     | JUST_RIGHT}},
+
+        { 1, 0, WIDGET_HOME_INFO_ID,     0,   88,   0, {JUST_TOP     | JUST_LEFT}},
+        { 1, 0, WIDGET_RADAR_ID,         0,   60, -44, {JUST_BOT     | JUST_LEFT}},
+        { 1, 0, WIDGET_ALARMS_ID,        0,    0,   0, {JUST_TOP     | JUST_HCENTER}},
+
+        { 2, 0, WIDGET_RC_CHANNELS_ID,   0,    0,   0, {JUST_TOP     | JUST_LEFT}},
+        { 2, 1, WIDGET_RADAR_ID,         0,    0,   0, {JUST_TOP     | JUST_HCENTER}},
+        { 2, 0, WIDGET_CONSOLE_ID,       0,    0,   0, {JUST_BOT     | JUST_LEFT}},
+
+        { 3, 0, WIDGET_FLIGHT_INFO_ID,   0,    0,   0, {JUST_VCENTER | JUST_HCENTER}},
+
+        { TABS_END, 0, 0, 0, 0, 0, {0}},
     },
 };
 
@@ -81,6 +81,7 @@ struct ch_switch {
 };
 
 #define RSSI_SOURCE_RC          0x00 /* 00 to 17 = CH1 to CH18 */
+#define RSSI_SOURCE_LINK        0x19 /* 25 to 28 = mavlink CH1 to CH4 quality */
 #define RSSI_SOURCE_ADC0        0x1d
 #define RSSI_SOURCE_ADC1        0x1e
 #define RSSI_SOURCE_MAVLINK     0x1f
@@ -155,6 +155,13 @@ static void rssi_monitor(void)
         case RSSI_SOURCE_ADC1:
             val = *(priv.rssi_adc);
             break;
+        case RSSI_SOURCE_LINK:
+        case RSSI_SOURCE_LINK + 1:
+        case RSSI_SOURCE_LINK + 2:
+        case RSSI_SOURCE_LINK + 3:
+            /* already in percent */
+            stats.rssi = mavlink_link_quality(config.rssi.mode.source - RSSI_SOURCE_LINK);
+            return;
     }
     
     switch (config.rssi.mode.units) {
@@ -487,7 +494,7 @@ static void shell_cmd_rssi(char *args, void *data)
     t = shell_arg_parser(args, argval, SHELL_CMD_CONFIG_ARGS);
     if (t < 1) {
         shell_printf("RSSI config:\n");
-        shell_printf(" Source: %u (0-17:RC1-18; 29:ADC0; 30:ADC1; 31:Mavlink RSSI)\n", cfg->mode.source);
+        shell_printf(" Source: %u (0-17:RC1-18; 25-28:Mavlink CH1-4 link quality; 29:ADC0; 30:ADC1; 31:Mavlink RSSI)\n", cfg->mode.source);
         shell_printf(" Units:  %u (0:percent; 1:raw)\n", cfg->mode.units);
         shell_printf(" Min:    %u\n", cfg->min);
         shell_printf(" Max:    %u\n", cfg->max);
@@ -393,6 +393,164 @@ void draw_jstr(char *buf, int x, int y, unsigned char just, struct canvas *ca,
 }
 
 
+/* text layer: only the part of a row that changed since it was shown
+ * is drawn and uploaded. the canvas holds a single row, one row is
+ * committed per render pass. rows must not be taller than 16. */
+void text_layer_init(struct text_layer *t, struct canvas *ca, unsigned char rows,
+        unsigned char cols, unsigned char font, char *shown)
+{
+    const struct font *f = get_font(font);
+    const struct font_char *fc;
+    unsigned char y0 = 0xff, y1 = 0;
+
+    /* row height covering every glyph */
+    for (fc = &f->chars['!' - 0x20]; fc <= &f->chars['~' - 0x20]; fc++) {
+        y0 = min(y0, fc->oy);
+        y1 = max(y1, fc->oy + fc->h);
+    }
+
+    t->rows = rows;
+    t->cols = cols;
+    t->font = font;
+    t->top = y0;
+    t->shown = shown;
+    t->stale = 0xffff;
+    memset(shown, 0, rows * cols);
+
+    ca->height = y1 - y0;
+    ca->rows = rows;
+}
+
+void text_layer_begin(struct text_layer *t, struct canvas *ca)
+{
+    /* screen contents are gone, redraw everything */
+    if (ca->fresh) {
+        t->stale = 0xffff;
+        ca->fresh = 0;
+    }
+    t->drawn = 0;
+    t->pending = 0;
+}
+
+static unsigned int get_strn_width(char *buf, unsigned char n, const struct font *f)
+{
+    unsigned int wid = 0;
+
+    while ((n-- > 0) && (*buf != '\0'))
+        wid += f->chars[*(buf++) - 0x20].w;
+    return wid;
+}
+
+void text_layer_row(struct text_layer *t, unsigned char row, char *str, struct canvas *ca)
+{
+    const struct font *f;
+    char *s = &t->shown[row * t->cols];
+    unsigned char stale = (t->stale >> row) & 1;
+    unsigned char i = 0, n = t->cols - 1;
+    unsigned int x = 0, x0, x1;
+
+    if (!stale && (strncmp(s, str, n) == 0))
+        return;
+    if (t->drawn) {
+        t->pending = 1;
+        return;
+    }
+
+    f = get_font(t->font);
+    if (stale) {
+        x1 = ca->area_width;
+    } else {
+        /* the common prefix stays on screen */
+        while ((i < n) && (s[i] != '\0') && (s[i] == str[i])) {
+            x += f->chars[s[i] - 0x20].w;
+            i++;
+        }
+        x1 = x + get_strn_width(&s[i], n - i, f);
+    }
+    x1 = max(x1, x + get_strn_width(&str[i], n - i, f));
+    x1 = min((x1 + 3) & 0xfffc, ca->area_width);
+    x0 = x & 0xfffc;
+
+    strncpy(s, str, n);
+    s[n] = '\0';
+    t->stale &= ~(1 << row);
+    if (x1 <= x0)
+        return;
+
+    /* first glyph inside the span */
+    i = 0;
+    x = 0;
+    while ((s[i] != '\0') && ((x + f->chars[s[i] - 0x20].w) <= x0))
+        x += f->chars[s[i++] - 0x20].w;
+
+    ca->x = ca->area_x + x0;
+    ca->y = ca->area_y + row * ca->height;
+    ca->width = x1 - x0;
+    ca->rwidth = ca->width >> 2;
+    draw_str(&s[i], x - x0, -t->top, ca, t->font);
+    t->drawn = 1;
+}
+
+
+/* scrolling strip: the samples are drawn into a ring of columns at the
+ * left of a kept canvas, each new sample only draws its own column.
+ * the video core rotates the ring when uploading so the oldest sample
+ * is on the left. len must be a multiple of 4. */
+void strip_init(struct strip *s, struct canvas *ca, u8 *samples,
+        unsigned int len, u8 base, unsigned char restored)
+{
+    unsigned int i;
+
+    s->samples = samples;
+    s->len = len;
+    s->base = base;
+    if (!restored) {
+        for (i = 0; i < len; i++)
+            samples[i] = base;
+        s->head = 0;
+    }
+    s->pending = len;
+
+    ca->keep = 1;
+    ca->strip_len = len;
+}
+
+void strip_push(struct strip *s, u8 y)
+{
+    s->samples[s->head] = y;
+    if (++s->head == s->len)
+        s->head = 0;
+    if (s->pending < s->len)
+        s->pending++;
+}
+
+void strip_render(struct strip *s, struct canvas *ca)
+{
+    unsigned int x;
+    u8 y;
+
+    /* canvas was cleared, draw the whole history */
+    if (ca->fresh) {
+        s->pending = s->len;
+        ca->fresh = 0;
+    }
+
+    x = s->head + s->len - s->pending;
+    if (x >= s->len)
+        x -= s->len;
+
+    for (; s->pending > 0; s->pending--) {
+        y = s->samples[x];
+        draw_vline(x, 0, ca->height-1, 0, ca);
+        draw_vline(x, s->base, y, 2, ca);
+        set_pixel(x, y, 1, ca);
+        if (++x == s->len)
+            x = 0;
+    }
+    ca->scroll = s->head;
+}
+
+
 #if 0
 void draw_line_wd(int x0, int y0, int x1, int y1, unsigned char v, unsigned char wd)
 {
@@ -35,6 +35,28 @@ struct polygon {
     unsigned char len;
 };
 
+/* grid of text rows drawn through a single row canvas */
+struct text_layer {
+    unsigned char rows, cols;
+    unsigned char font, top;
+    /* text currently on screen (rows * cols) */
+    char *shown;
+    /* rows to redraw completely */
+    u16 stale;
+    /* current render pass */
+    unsigned char drawn, pending;
+};
+
+/* time series plot scrolled at upload time, one column per sample */
+struct strip {
+    /* sample ring, pixel row of each column */
+    u8 *samples;
+    unsigned int len, head;
+    /* samples not drawn yet */
+    unsigned int pending;
+    u8 base;
+};
+
 
 /* in assembly */
 extern void set_pixel(unsigned int x, unsigned int y, unsigned int v, struct canvas *ca);
@@ -56,6 +78,16 @@ void draw_jstr(char *buf, int x, int y, unsigned char just, struct canvas *ca, u
 const struct font* get_font(unsigned char idx);
 unsigned int get_str_width(char *buf, const struct font *f);
 
+void text_layer_init(struct text_layer *t, struct canvas *ca, unsigned char rows,
+        unsigned char cols, unsigned char font, char *shown);
+void text_layer_begin(struct text_layer *t, struct canvas *ca);
+void text_layer_row(struct text_layer *t, unsigned char row, char *str, struct canvas *ca);
+
+void strip_init(struct strip *s, struct canvas *ca, u8 *samples,
+        unsigned int len, u8 base, unsigned char restored);
+void strip_push(struct strip *s, u8 y);
+void strip_render(struct strip *s, struct canvas *ca);
+
 void transform_polygon(struct polygon *p, int x, int y, int rot);
 void move_polygon(struct polygon *p, int x, int y);
 void draw_polygon(struct polygon *p, unsigned char v, struct canvas *ca);
@@ -21,6 +21,16 @@
 
 extern struct alceosd_config config;
 
+#define HOME_REQ_PERIOD     (1000)  /* ms between home position requests */
+#define HOME_REQ_RETRIES    (3)     /* before falling back to WP0 */
+
+enum {
+    HOME_SRC_NONE = 0,
+    HOME_SRC_POSITION,
+    HOME_SRC_WP0,
+    HOME_SRC_GPS,
+};
+
 /* data that is passed to widgets */
 struct home_data home;
 
@@ -28,6 +38,9 @@ static struct home_priv {
     struct gps_coord home_coord, uav_coord;
     unsigned int altitude, home_altitude;
     int heading;
+
+    unsigned char source, retries;
+    u16 last_req, updates;
 } priv;
 
 struct home_data* get_home_data(void)
@@ -35,13 +48,84 @@ struct home_data* get_home_data(void)
     return &home;
 }
 
+struct gps_coord* get_home_coord(void)
+{
+    return &priv.home_coord;
+}
+
+static void request_home_position(void)
+{
+    mavlink_message_t this_msg;
+
+    mavlink_msg_command_long_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &this_msg,
+                        config.mav.uav_sysid, MAV_COMP_ID_ALL,
+                        MAV_CMD_GET_HOME_POSITION, 0, 0, 0, 0, 0, 0, 0, 0);
+    mavlink_send_msg(&this_msg);
+    priv.last_req = get_millis16();
+    priv.retries++;
+}
+
+static void mav_home_position(mavlink_message_t *msg, void *d)
+{
+    mavlink_home_position_t hp;
+
+    if (msg->sysid != config.mav.uav_sysid)
+        return;
+
+    switch (home.lock) {
+        case HOME_WAIT:
+            break;
+        case HOME_LOCKED:
+            /* follow home changes unless it was forced */
+            if (priv.source != HOME_SRC_GPS)
+                break;
+        default:
+            return;
+    }
+
+    mavlink_msg_home_position_decode(msg, &hp);
+    priv.home_coord.lat = DEG2RAD(hp.latitude / 10000000.0);
+    priv.home_coord.lon = DEG2RAD(hp.longitude / 10000000.0);
+    priv.home_altitude = (unsigned int) (hp.altitude / 1000);
+
+    if (home.lock == HOME_WAIT)
+        home.lock = HOME_GOT;
+    else
+        priv.updates++;
+    priv.source = HOME_SRC_POSITION;
+}
+
+static void mav_cmd_ack(mavlink_message_t *msg, void *d)
+{
+    if ((msg->sysid != config.mav.uav_sysid) ||
+            (mavlink_msg_command_ack_get_command(msg) != MAV_CMD_GET_HOME_POSITION))
+        return;
+
+    /* late answer, already falling back to WP0 */
+    if ((home.lock != HOME_WAIT) || (priv.retries > HOME_REQ_RETRIES))
+        return;
+
+    /* not supported, go straight to WP0 */
+    if (mavlink_msg_command_ack_get_result(msg) != MAV_RESULT_ACCEPTED) {
+        priv.retries = HOME_REQ_RETRIES;
+        priv.last_req = get_millis16() - HOME_REQ_PERIOD;
+    }
+}
+
+static void home_wait(void)
+{
+    priv.source = HOME_SRC_NONE;
+    priv.retries = 0;
+    home.lock = HOME_WAIT;
+}
+
 static void calc_home(struct timer *t, void *d)
 {
     mavlink_heartbeat_t *hb = mavdata_get(MAVLINK_MSG_ID_HEARTBEAT);
     mavlink_global_position_int_t *gpi;
+    s16 wp0_alt;
+    u16 now;
 
-    mavlink_message_t this_msg;
-    
     switch (home.lock) {
         case HOME_NONE:
         default:
@@ -49,23 +133,34 @@ static void calc_home(struct timer *t, void *d)
                 return;
 
             /* check arming status */
-            if (hb->base_mode & MAV_MODE_FLAG_SAFETY_ARMED)
-                home.lock = HOME_WAIT;
+            if (hb->base_mode & MAV_MODE_FLAG_SAFETY_ARMED) {
+                home_wait();
+                set_timer_period(t, 100);
+            }
             
             break;
         case HOME_WAIT:
-            if (mavdata_age(MAVLINK_MSG_ID_MISSION_ITEM) > 2000) {
-                /* when UAV is armed, home is WP0 */
-                mavlink_msg_mission_request_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &this_msg,
-                                    config.mav.uav_sysid, MAV_COMP_ID_ALL, 0);
-                mavlink_send_msg(&this_msg);
-            } else {
-                mavlink_mission_item_t *mi = mavdata_get(MAVLINK_MSG_ID_MISSION_ITEM);
-                priv.home_coord.lat = DEG2RAD(mi->x);
-                priv.home_coord.lon = DEG2RAD(mi->y);
-                priv.home_altitude = (unsigned int) mi->z;
+            /* home is set on arming, ask for it */
+            now = get_millis16();
+            if ((priv.retries > 0) && ((u16) (now - priv.last_req) < HOME_REQ_PERIOD))
+                break;
+            if (priv.retries < HOME_REQ_RETRIES) {
+                request_home_position();
+                break;
+            }
+
+            /* no HOME_POSITION, home is WP0; ask for that item
+               alone, one request per period until it is set */
+            if (priv.retries == HOME_REQ_RETRIES) {
+                priv.retries++;
+            } else if (mission_get_wp0(&priv.home_coord, &wp0_alt) == 0) {
+                priv.home_altitude = (unsigned int) wp0_alt;
+                priv.source = HOME_SRC_WP0;
                 home.lock = HOME_GOT;
+                break;
             }
+            mission_request_wp0();
+            priv.last_req = now;
             break;
         case HOME_GOT:
             home.lock = HOME_LOCKED;
@@ -73,6 +168,11 @@ static void calc_home(struct timer *t, void *d)
             break;
         case HOME_LOCKED:
         {
+            /* WP0 follows mission downloads */
+            if ((priv.source == HOME_SRC_WP0) &&
+                    (mission_get_wp0(&priv.home_coord, &wp0_alt) == 0))
+                priv.home_altitude = (unsigned int) wp0_alt;
+
             gpi = mavdata_get(MAVLINK_MSG_ID_GLOBAL_POSITION_INT);
  
             priv.uav_coord.lat = DEG2RAD(gpi->lat / 10000000.0);
@@ -91,6 +191,7 @@ static void calc_home(struct timer *t, void *d)
             home.altitude = priv.altitude - priv.home_altitude;
             break;
         case HOME_RESET:
+            priv.source = HOME_SRC_NONE;
             home.lock = HOME_NONE;
             set_timer_period(t, 1000);
             break;
@@ -99,6 +200,7 @@ static void calc_home(struct timer *t, void *d)
             priv.home_coord.lat = DEG2RAD(gpi->lat / 10000000.0);
             priv.home_coord.lon = DEG2RAD(gpi->lon / 10000000.0);
             priv.home_altitude = (unsigned int) (gpi->alt / 1000);
+            priv.source = HOME_SRC_GPS;
             home.lock = HOME_GOT;
             break;
         }
@@ -108,20 +210,32 @@ static void calc_home(struct timer *t, void *d)
 void init_home(void)
 {
     home.lock = HOME_NONE;
+    priv.source = HOME_SRC_NONE;
+    /* the handlers follow the uav sysid, it may change at runtime */
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_HOME_POSITION,
+                mav_home_position, CALLBACK_PERSISTENT, NULL);
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_COMMAND_ACK,
+                mav_cmd_ack, CALLBACK_PERSISTENT, NULL);
     add_timer(TIMER_ALWAYS, 1000, calc_home, NULL);
 }
 
 static void shell_cmd_stats(char *args, void *data)
 {
+    const char source[4][10] = {"none", "HOME_POS", "WP0", "GPS"};
+
     switch (home.lock) {
         default:
         case HOME_NONE:
             shell_printf("No home; UAV not armed\n");
             break;
         case HOME_WAIT:
-            shell_printf("Requesting WP0 (home)\n");
+            if (priv.retries <= HOME_REQ_RETRIES)
+                shell_printf("Requesting home position\n");
+            else
+                shell_printf("Requesting WP0 (home)\n");
             break;
         case HOME_LOCKED:
+            shell_printf("Home source: %s (%u updates)\n", source[priv.source], priv.updates);
             shell_printf("Home GPS coords: lat=%.6f lon=%.6f\n", priv.home_coord.lat, priv.home_coord.lon);
             shell_printf("Home M.S.L. altitude: %um\n\n", priv.home_altitude);
             shell_printf("Relative altitude to home: %um\n", home.altitude);
@@ -146,7 +260,7 @@ static void shell_cmd_lock(char *args, void *data)
                 home.lock = HOME_FORCE;
                 break;
             case 2:
-                home.lock = HOME_WAIT;
+                home_wait();
                 break;
         }
     } else {
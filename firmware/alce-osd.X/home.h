@@ -38,6 +38,7 @@ struct home_data {
 
 void init_home(void);
 struct home_data* get_home_data(void);
+struct gps_coord* get_home_coord(void);
 void shell_cmd_home(char *args, void *data);
 
 #endif	/* HOME_H */
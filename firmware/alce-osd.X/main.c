@@ -377,6 +377,9 @@ int main(void)
     /* welcome message */
     console_printf("AlceOSD hw%dv%d fw%d.%d.%d\n", hw_rev >> 4, hw_rev & 0xf, VERSION_MAJOR, VERSION_MINOR, VERSION_DEV);
 
+    /* init mission download */
+    init_mission();
+
     /* init home tracking */
     init_home();
 
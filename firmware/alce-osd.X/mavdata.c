@@ -23,14 +23,26 @@
         mavlink_##y##_t alce_##y; \
         const mavlink_message_info_t __attribute__((space(psv))) mi_##x = MAVLINK_MESSAGE_INFO_##x
 #define MAVDATA_DEF(x,y) \
-        m[MAVLINK_MSG_ID_##x].data = &alce_##y; \
-        m[MAVLINK_MSG_ID_##x].decode = ((void*) mavlink_msg_##y##_decode); \
-        m[MAVLINK_MSG_ID_##x].info = &mi_##x; \
-        m[MAVLINK_MSG_ID_##x].info_pag = __builtin_psvpage(&mi_##x)
+        mavdata_idx[MAVLINK_MSG_ID_##x] = ++nr_slots; \
+        m[nr_slots].data = &alce_##y; \
+        m[nr_slots].decode = ((void*) mavlink_msg_##y##_decode); \
+        m[nr_slots].info = &mi_##x; \
+        m[nr_slots].info_pag = __builtin_psvpage(&mi_##x)
 
 extern struct alceosd_config config;
 
-struct mavdata_state m[256];
+/* slots for tracked messages only, slot 0 is an empty entry that
+   every untracked msgid maps to */
+#define MAVDATA_SLOTS   (19)
+
+static struct mavdata_state m[MAVDATA_SLOTS];
+static u8 mavdata_idx[256];
+static u8 nr_slots;
+
+static inline struct mavdata_state* mavdata_slot(unsigned int id)
+{
+    return &m[mavdata_idx[id & 0xff]];
+}
 
 MAVDATA_INFO(HEARTBEAT, heartbeat);
 MAVDATA_INFO(SYS_STATUS, sys_status);
@@ -51,6 +63,30 @@ MAVDATA_INFO(WIND, wind);
 MAVDATA_INFO(SCALED_PRESSURE, scaled_pressure);
 MAVDATA_INFO(SYSTEM_TIME, system_time);
 
+/* attitude extrapolation between ATTITUDE messages */
+#define ATT_BLEND_TIME      (100000)    /* us to fade out a correction */
+#define ATT_MAX_PREDICT     (250000)    /* us, hold the attitude after this */
+
+static struct {
+    /* local time of the last sample (us) */
+    u32 time;
+    /* prediction minus sample when it arrived, faded out */
+    float corr[3];
+    /* prediction error (rad) */
+    u16 samples;
+    float err_sum[3], err_max[3];
+} att_pred;
+
+static void attitude_decode(struct mavdata_lazy *l, void *d);
+
+/* attitude comes at high rates and its decode runs the predictor */
+static u8 attitude_raw[MAVLINK_MSG_ID_ATTITUDE_LEN];
+static struct mavdata_lazy attitude_lazy = {
+    .raw = attitude_raw,
+    .len = MAVLINK_MSG_ID_ATTITUDE_LEN,
+    .decode = attitude_decode,
+};
+
 void mavdata_init(void)
 {
     /* mavlink info section is > 32k
@@ -58,7 +94,9 @@ void mavdata_init(void)
        because the __builtin_psvpage isn't able to generate the page
        address at compile time */
     
-    memset(m, 0, sizeof(struct mavdata_state) * 256);
+    memset(m, 0, sizeof(struct mavdata_state) * MAVDATA_SLOTS);
+    memset(mavdata_idx, 0, sizeof(mavdata_idx));
+    nr_slots = 0;
     MAVDATA_DEF(HEARTBEAT, heartbeat);
     MAVDATA_DEF(SYS_STATUS, sys_status);
     MAVDATA_DEF(ATTITUDE, attitude);
@@ -77,6 +115,80 @@ void mavdata_init(void)
     MAVDATA_DEF(WIND, wind);
     MAVDATA_DEF(SCALED_PRESSURE, scaled_pressure);
     MAVDATA_DEF(SYSTEM_TIME, system_time);
+
+    mavdata_slot(MAVLINK_MSG_ID_ATTITUDE)->lazy = &attitude_lazy;
+    memset(&att_pred, 0, sizeof(att_pred));
+}
+
+static float wrap_pi(float a)
+{
+    if (a > PI)
+        a -= 2*PI;
+    else if (a < -PI)
+        a += 2*PI;
+    return a;
+}
+
+/* rates are body rates, close enough to euler rates over a telemetry
+ * period for display purposes */
+static void attitude_predict(u32 now, float *a)
+{
+    mavlink_attitude_t *att = &alce_attitude;
+    u32 elapsed = now - att_pred.time;
+    float dt, fade;
+
+    dt = (float) min(elapsed, ATT_MAX_PREDICT) / 1000000.0;
+    if (elapsed < ATT_BLEND_TIME)
+        fade = 1.0 - (float) elapsed / ATT_BLEND_TIME;
+    else
+        fade = 0;
+
+    a[0] = att->roll + att->rollspeed * dt + att_pred.corr[0] * fade;
+    a[1] = att->pitch + att->pitchspeed * dt + att_pred.corr[1] * fade;
+    a[2] = att->yaw + att->yawspeed * dt + att_pred.corr[2] * fade;
+}
+
+static void attitude_decode(struct mavdata_lazy *l, void *d)
+{
+    mavlink_attitude_t *att = d;
+    u32 now = l->rx_time;
+    float p[3], e;
+    unsigned char i;
+
+    /* predict at arrival time, samples that were never read are skipped */
+    attitude_predict(now, p);
+    /* payload has the struct layout on this (little endian) target */
+    memcpy(att, l->raw, l->len);
+
+    if (!mavdata_slot(MAVLINK_MSG_ID_ATTITUDE)->valid) {
+        /* first sample, nothing to correct */
+        att_pred.time = now;
+        return;
+    }
+
+    /* blend from the prediction into the new sample */
+    att_pred.corr[0] = wrap_pi(p[0] - att->roll);
+    att_pred.corr[1] = wrap_pi(p[1] - att->pitch);
+    att_pred.corr[2] = wrap_pi(p[2] - att->yaw);
+    for (i = 0; i < 3; i++) {
+        e = fabs(att_pred.corr[i]);
+        att_pred.err_sum[i] += e;
+        if (e > att_pred.err_max[i])
+            att_pred.err_max[i] = e;
+    }
+    att_pred.samples++;
+    att_pred.time = now;
+}
+
+void mavdata_get_attitude(struct mavdata_attitude *a)
+{
+    float p[3];
+
+    mavdata_get(MAVLINK_MSG_ID_ATTITUDE);
+    attitude_predict(get_micros(), p);
+    a->roll = wrap_pi(p[0]);
+    a->pitch = p[1];
+    a->yaw = wrap_pi(p[2]);
 }
 
 void mavdata_store(mavlink_message_t *msg)
@@ -90,46 +202,65 @@ void mavdata_store(mavlink_message_t *msg)
     if (! ((target_sys == -1) || (target_sys == config.mav.osd_sysid)))
         return;
    
-    s = &m[msg->msgid];
-    if (s->decode != NULL) {
+    s = mavdata_slot(msg->msgid);
+    if (s->decode == NULL)
+        return;
+
+    if (s->lazy != NULL) {
+        /* keep the payload, decode when someone reads it */
+        memcpy(s->lazy->raw, _MAV_PAYLOAD(msg), min(msg->len, s->lazy->len));
+        s->lazy->rx_time = get_micros();
+        s->dirty = 1;
+    } else {
         s->decode(msg, s->data);
-        t = get_millis();
-        s->period = t - s->time;
-        s->time = t;
+        s->decodes++;
+        s->valid = 1;
     }
+    s->arrivals++;
+    t = get_millis();
+    s->period = t - s->time;
+    s->time = t;
 }
 
 void* mavdata_get(unsigned int id)
 {
-    return m[id].data;
+    struct mavdata_state *s = mavdata_slot(id);
+
+    if (s->dirty) {
+        s->dirty = 0;
+        s->lazy->decode(s->lazy, s->data);
+        s->decodes++;
+        s->valid = 1;
+    }
+    return s->data;
 }
 
 unsigned long mavdata_time(unsigned int id)
 {
-    return m[id].time;
+    return mavdata_slot(id)->time;
 }
 
 unsigned long mavdata_age(unsigned int id)
 {
-    if (m[id].time != 0)
-        return get_millis() - m[id].time;
+    if (mavdata_slot(id)->time != 0)
+        return get_millis() - mavdata_slot(id)->time;
     else
         return 99999999;
 }
 
 unsigned long mavdata_period(unsigned int id)
 {
-    return m[id].period;
+    return mavdata_slot(id)->period;
 }
 
 static void mavdata_info_name(u16 id, char *name)
 {
-    int pag, new_pag = m[id].info_pag;
+    int pag, new_pag = mavdata_slot(id)->info_pag;
     char *src;
 
     pag = DSRPAG;
     DSRPAG = new_pag;
-    src = (s8*) m[id].info->name;
+    src = (s8*) mavdata_slot(id)->info->name;
     do {
         *(name++) = *(src);
     } while (*(src++) != '\0');
@@ -138,48 +269,48 @@ static void mavdata_info_name(u16 id, char *name)
 
 static u16 mavdata_info_num_fields(u16 id)
 {
-    int pag, new_pag = m[id].info_pag;
+    int pag, new_pag = mavdata_slot(id)->info_pag;
     u16 ret = 0;
 
     pag = DSRPAG;
     DSRPAG = new_pag;
-    ret = m[id].info->num_fields;
+    ret = mavdata_slot(id)->info->num_fields;
     DSRPAG = pag;
     return ret;
 }
 
 static u16 mavdata_info_field_type(u16 id, u8 nr)
 {
-    int pag, new_pag = m[id].info_pag;
+    int pag, new_pag = mavdata_slot(id)->info_pag;
     u16 ret = 0;
 
     pag = DSRPAG;
     DSRPAG = new_pag;
-    ret = (u16) m[id].info->fields[nr].type;
+    ret = (u16) mavdata_slot(id)->info->fields[nr].type;
     DSRPAG = pag;
     return ret;
 }
 
 static u16 mavdata_info_field_structoffset(u16 id, u8 nr)
 {
-    int pag, new_pag = m[id].info_pag;
+    int pag, new_pag = mavdata_slot(id)->info_pag;
     u16 ret = 0;
 
     pag = DSRPAG;
     DSRPAG = new_pag;
-    ret = m[id].info->fields[nr].structure_offset;
+    ret = mavdata_slot(id)->info->fields[nr].structure_offset;
     DSRPAG = pag;
     return ret;
 }
 
 static void mavdata_info_field_name(u16 id, u8 nr, char *name)
 {
-    int pag, new_pag = m[id].info_pag;
+    int pag, new_pag = mavdata_slot(id)->info_pag;
     char *src;
 
     pag = DSRPAG;
     DSRPAG = new_pag;
-    src = (s8*) m[id].info->fields[nr].name;
+    src = (s8*) mavdata_slot(id)->info->fields[nr].name;
     do {
         *(name++) = *(src);
     } while (*(src++) != '\0');
@@ -192,10 +323,10 @@ static void shell_cmd_stats(char *args, void *data)
     u32 age;
     u16 i;
     
-    shell_printf(" id | age(ms) | rate(Hz) | name\n");
-    shell_printf("----+---------+----------+---------------\n");
+    shell_printf(" id | age(ms) | rate(Hz) |  rx   | decoded | name\n");
+    shell_printf("----+---------+----------+-------+---------+---------------\n");
     for (i = 0; i < 256; i++) {
-        if (m[i].decode == NULL)
+        if (mavdata_slot(i)->decode == NULL)
             continue;
         shell_printf("%3d |", i);
         age = mavdata_age(i);
@@ -208,6 +339,7 @@ static void shell_cmd_stats(char *args, void *data)
             else
                 shell_printf("          | ");
         }
+        shell_printf("%5lu | %7lu | ", mavdata_slot(i)->arrivals, mavdata_slot(i)->decodes);
         mavdata_info_name(i, buf);
         shell_printf("%s\n", buf);
     }
@@ -230,16 +362,17 @@ static void shell_cmd_display(char *args, void *data)
         shell_printf(" -i <msgid>  mavlink msgid\n");
     } else {
         i = atoi(p->val);
-        if (m[i].decode == NULL) {
+        if (mavdata_slot(i)->decode == NULL) {
             shell_printf("not found\n");
             return;
         }
+        mavdata_get(i);
         mavdata_info_name(i, buf);
         num_fields = mavdata_info_num_fields(i);
         shell_printf("%s\n", buf);
         for (j = 0; j < num_fields; j++) {
             u16 ftype = mavdata_info_field_type(i, j);
-            u16 data_offset = (u16) (mavdata_info_field_structoffset(i, j) + m[i].data);
+            u16 data_offset = (u16) (mavdata_info_field_structoffset(i, j) + mavdata_slot(i)->data);
             mavdata_info_field_name(i, j, buf);
             shell_printf("[%8s] ", mavdata_type_name[ftype]);
             shell_printf("%34s = ", buf);
@@ -294,8 +427,37 @@ static void shell_cmd_display(char *args, void *data)
 }
 
 
+#define SHELL_CMD_ATTITUDE_ARGS 1
+static void shell_cmd_attitude(char *args, void *data)
+{
+    struct shell_argval argval[SHELL_CMD_ATTITUDE_ARGS+1];
+    const char axis[3][6] = {"roll", "pitch", "yaw"};
+    unsigned char i;
+
+    shell_arg_parser(args, argval, SHELL_CMD_ATTITUDE_ARGS);
+    if (shell_get_argval(argval, 'r') != NULL) {
+        att_pred.samples = 0;
+        memset(att_pred.err_sum, 0, sizeof(att_pred.err_sum));
+        memset(att_pred.err_max, 0, sizeof(att_pred.err_max));
+        shell_printf("stats reset\n");
+        return;
+    }
+
+    shell_printf("attitude prediction error at sample arrival (%u samples)\n",
+                    att_pred.samples);
+    shell_printf(" axis  | avg(deg) | max(deg)\n");
+    shell_printf("-------+----------+---------\n");
+    for (i = 0; i < 3; i++) {
+        shell_printf(" %-5s | %8.2f | %8.2f\n", axis[i],
+            att_pred.samples ? RAD2DEG(att_pred.err_sum[i] / att_pred.samples) : 0.0,
+            RAD2DEG(att_pred.err_max[i]));
+    }
+    shell_printf("\n -r  reset stats\n");
+}
+
 static const struct shell_cmdmap_s mavlink_cmdmap[] = {
     {"stats", shell_cmd_stats, "Brief list of all captured data", SHELL_CMD_SIMPLE},
+    {"attitude", shell_cmd_attitude, "Attitude prediction stats", SHELL_CMD_SIMPLE},
     {"display", shell_cmd_display, "Display mavlink data", SHELL_CMD_SIMPLE},
     {"", NULL, ""},
 };
@@ -19,6 +19,15 @@
 #ifndef _UAV_H
 #define	_UAV_H
 
+/* messages decoded on first access instead of on arrival */
+struct mavdata_lazy {
+    u8 *raw;
+    u8 len;
+    /* arrival time (us) */
+    u32 rx_time;
+    void (*decode)(struct mavdata_lazy *l, void *d);
+};
+
 struct mavdata_state {
     void *data;
     unsigned long time;
@@ -27,6 +36,17 @@ struct mavdata_state {
     void (*decode)(mavlink_message_t *msg, void *d);
     const mavlink_message_info_t *info;
     int info_pag;
+
+    struct mavdata_lazy *lazy;
+    u8 dirty;
+    /* data holds a decoded sample */
+    u8 valid;
+    u32 arrivals, decodes;
+};
+
+/* attitude extrapolated to the current time (rad) */
+struct mavdata_attitude {
+    float roll, pitch, yaw;
 };
 
 void mavdata_init(void);
@@ -35,6 +55,7 @@ void* mavdata_get(unsigned int id);
 unsigned long mavdata_time(unsigned int id);
 unsigned long mavdata_age(unsigned int id);
 unsigned long mavdata_period(unsigned int id);
+void mavdata_get_attitude(struct mavdata_attitude *a);
 
 void shell_cmd_mavdata(char *args, void *data);
 
@@ -18,27 +18,98 @@
 
 #include "alce-osd.h"
 
-#define MAX_TX_WAIT_TIME    100
-
-#define MAX_MAVLINK_CALLBACKS 20
-#define MAX_MAVLINK_ROUTES 10
+#define MAX_MAVLINK_CALLBACKS 32
+/* route hash table, must be a power of 2 */
+#define MAVLINK_ROUTE_SLOTS 16
+#define MAX_MAVLINK_ROUTES  12
+/* seconds without traffic before a route expires */
+#define MAVLINK_ROUTE_TTL   10
 
 #define UAV_LAST_SEEN_TIMEOUT   2000
 
 static struct mavlink_callback callbacks[MAX_MAVLINK_CALLBACKS];
 static unsigned char nr_callbacks = 0;
+/* first callback of each msgid and type chain (slot+1, 0=none) */
+static unsigned char callback_msgid[256];
+static unsigned char callback_type[CALLBACK_TYPES];
 
 static unsigned char active_channel_mask = 0, total_routes = 0;
-
-static unsigned int pidx = 0, total_params = 0;
+static u16 evicted_routes = 0;
+
+static unsigned int total_params = 0;
+
+/* param streaming tick (ms) */
+#define PARAM_STREAM_TICK   (10)
+/* pending single param reads, must be a power of 2 */
+#define PARAM_QUEUE_SIZE    (16)
+#define PARAM_VALUE_LEN     (MAVLINK_MSG_ID_PARAM_VALUE_LEN + MAVLINK_NUM_NON_PAYLOAD_BYTES)
+
+static struct param_stream {
+    struct timer *timer;
+    /* list progress */
+    unsigned int next, total;
+    u16 start;
+    /* indexes requested with PARAM_REQUEST_READ */
+    u16 queue[PARAM_QUEUE_SIZE];
+    u8 q_rd, q_len;
+    /* byte budget */
+    u16 tokens, refill;
+} pstream;
 
 struct uart_client mavlink_uart_clients[MAVLINK_COMM_NUM_BUFFERS];
 
+static struct mavlink_tx_stats {
+    u16 sent, dropped;
+    /* routed traffic: forwarded, dropped by the rules, held back by
+       a rate cap or the byte budget */
+    u16 fwd, filtered, shaped;
+} tx_stats[MAVLINK_COMM_NUM_BUFFERS];
+
+/* sequence tracking of incoming traffic */
+static struct mavlink_rx_stats {
+    u16 dup, lost, crc;
+    u16 packets;
+    u32 bytes;
+    /* counters at the last rate update */
+    u16 last_packets, last_lost, last_bytes;
+    /* link quality over the last second */
+    u16 pps, bps;
+    u8 quality;
+} rx_stats[MAVLINK_COMM_NUM_BUFFERS];
+
+/* forwarding shaper state */
+static struct mavlink_fwd_state {
+    u16 last[MAVLINK_FWD_RULES];
+    u16 tokens, refill;
+} fwd_state[MAVLINK_COMM_NUM_BUFFERS];
+
+/* sequence numbers kept in the duplicate window */
+#define MAVLINK_SEQ_WINDOW  (16)
+
+/* one entry per component, open addressing hashed by sysid so that
+   all components of a system sit in the same probe run */
 static struct mavlink_route_entry {
-    unsigned char ch;
     unsigned char sysid;
     unsigned char compid;
-} routes[MAX_MAVLINK_ROUTES];
+    /* channels where the component was seen */
+    unsigned char ch_mask;
+    /* seconds left until each channel expires */
+    unsigned char ttl[MAVLINK_COMM_NUM_BUFFERS];
+    u16 packets;
+    u32 bytes;
+    /* last sequence number seen on each channel and on any channel,
+       with a bitmap of the 16 sequence numbers before it and the
+       checksum of each (it covers msgid and payload) */
+    unsigned char ch_seq[MAVLINK_COMM_NUM_BUFFERS];
+    unsigned char seq;
+    u16 seen;
+    u16 crc[MAVLINK_SEQ_WINDOW];
+    /* packets missing on all channels */
+    u16 lost;
+    /* rates over the last second */
+    u16 last_packets, last_bytes;
+    u16 pps, bps;
+} routes[MAVLINK_ROUTE_SLOTS];
 
 extern struct alceosd_config config;
 
@@ -60,6 +131,26 @@ const struct param_def params_mavlink_rates[] = {
     PARAM("MAV_EXTRA3",   MAV_PARAM_TYPE_UINT8, &config.mav.streams[7], NULL),
 
     PARAM("MAV_SHELL",   MAV_PARAM_TYPE_UINT8, &config.mav.shell_rate, NULL),
+    PARAM("MAV_DEDUP",   MAV_PARAM_TYPE_UINT8, &config.mav.dedup, NULL),
+    PARAM("MAV_PRM_LOAD", MAV_PARAM_TYPE_UINT8, &config.mav.param_load, NULL),
+    PARAM("MAV_MIS_POLL", MAV_PARAM_TYPE_UINT8, &config.mav.mission_poll, NULL),
+    PARAM_END,
+};
+
+#define PARAMS_FWD_RULE(c, r) \
+    PARAM("MAV_FWD" #c "_ID" #r, MAV_PARAM_TYPE_UINT8, &config.mav.fwd[c-1].id[r-1], NULL), \
+    PARAM("MAV_FWD" #c "_RT" #r, MAV_PARAM_TYPE_UINT8, &config.mav.fwd[c-1].rate[r-1], NULL)
+#define PARAMS_FWD(c) \
+    PARAM("MAV_FWD" #c "_MODE", MAV_PARAM_TYPE_UINT8, &config.mav.fwd[c-1].mode, NULL), \
+    PARAM("MAV_FWD" #c "_BPS", MAV_PARAM_TYPE_UINT16, &config.mav.fwd[c-1].budget, NULL), \
+    PARAMS_FWD_RULE(c, 1), PARAMS_FWD_RULE(c, 2), \
+    PARAMS_FWD_RULE(c, 3), PARAMS_FWD_RULE(c, 4)
+
+const struct param_def params_mavlink_fwd[] = {
+    PARAMS_FWD(1),
+    PARAMS_FWD(2),
+    PARAMS_FWD(3),
+    PARAMS_FWD(4),
     PARAM_END,
 };
 
@@ -292,22 +383,43 @@ void mavlink_get_targets(mavlink_message_t *msg, int *sysid, int *compid)
 }
 /* *************** */
 
+/* messages that may use the reserved room of the tx rings */
+static unsigned char mavlink_tx_prio(unsigned char msgid)
+{
+    switch (msgid) {
+        case MAVLINK_MSG_ID_HEARTBEAT:
+        case MAVLINK_MSG_ID_COMMAND_LONG:
+        case MAVLINK_MSG_ID_COMMAND_ACK:
+        case MAVLINK_MSG_ID_SET_MODE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 static void mavlink_send_msg_to_channels(unsigned char ch_mask, mavlink_message_t *msg)
 {
-    unsigned char i;
+    struct uart_client *cli;
+    unsigned char i, prio;
     unsigned int len;
     unsigned char buf[MAVLINK_MAX_PACKET_LEN];
-    u16 t;
+    int ret;
 
     len = mavlink_msg_to_send_buffer(buf, msg);
+    prio = mavlink_tx_prio(msg->msgid);
     
     for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
         if (ch_mask & 1) {
-            t = get_millis16();
-            while ((get_millis16() - t) < MAX_TX_WAIT_TIME) {
-                if (mavlink_uart_clients[i].write(buf, len) == 0)
-                    break;
-            }
+            /* queued or dropped, never waits for the uart */
+            cli = &mavlink_uart_clients[i];
+            if (prio)
+                ret = cli->write_prio(buf, len);
+            else
+                ret = cli->write(buf, len);
+            if (ret == 0)
+                tx_stats[i].sent++;
+            else
+                tx_stats[i].dropped++;
         }
         ch_mask = ch_mask >> 1;
         if (ch_mask == 0)
@@ -315,30 +427,137 @@ static void mavlink_send_msg_to_channels(unsigned char ch_mask, mavlink_message_
     }
 }
 
-static void mavlink_learn_route(unsigned char ch, mavlink_message_t *msg)
+static inline unsigned char mavlink_route_hash(unsigned char sysid)
 {
-    unsigned char i;
+    return (sysid ^ (sysid >> 4)) & (MAVLINK_ROUTE_SLOTS - 1);
+}
+
+static void mavlink_del_route(unsigned char i)
+{
+    unsigned char j = i, h;
+
+    /* backward shift the entries of the probe run into the hole */
+    for (;;) {
+        routes[i].ch_mask = 0;
+        do {
+            j = (j + 1) & (MAVLINK_ROUTE_SLOTS - 1);
+            if (routes[j].ch_mask == 0) {
+                total_routes--;
+                return;
+            }
+            h = mavlink_route_hash(routes[j].sysid);
+        } while (((j > i) && (h > i) && (h <= j)) ||
+                 ((j < i) && ((h > i) || (h <= j))));
+        routes[i] = routes[j];
+        i = j;
+    }
+}
+
+static void mavlink_evict_route(void)
+{
+    unsigned char i, c, ttl, best = 0, best_ttl = 0xff;
+
+    for (i = 0; i < MAVLINK_ROUTE_SLOTS; i++) {
+        if (routes[i].ch_mask == 0)
+            continue;
+        ttl = 0;
+        for (c = 0; c < MAVLINK_COMM_NUM_BUFFERS; c++)
+            ttl = max(ttl, routes[i].ttl[c]);
+        if (ttl < best_ttl) {
+            best_ttl = ttl;
+            best = i;
+        }
+    }
+#ifdef ROUTING_DEBUG
+    shell_printf("evicted route %u %u\n",
+             (unsigned) routes[best].sysid, (unsigned) routes[best].compid);
+#endif
+    mavlink_del_route(best);
+    evicted_routes++;
+}
+
+/* returns 1 if the same packet was already received on another channel */
+static unsigned char mavlink_check_seq(struct mavlink_route_entry *r,
+                                        unsigned char ch, mavlink_message_t *msg)
+{
+    unsigned char seq = msg->seq, d, gap, dup = 0;
+    u16 *crc = &r->crc[seq & (MAVLINK_SEQ_WINDOW - 1)];
+
+    if (r->ch_mask == 0) {
+        /* new component */
+        r->seq = seq;
+        r->seen = 1;
+        r->ch_seq[ch] = seq;
+        *crc = msg->checksum;
+        return 0;
+    }
+
+    /* losses on this channel */
+    gap = seq - r->ch_seq[ch];
+    if (r->ttl[ch] != 0 && gap > 1 && gap < 128)
+        rx_stats[ch].lost += gap - 1;
+
+    d = seq - r->seq;
+    if (d != 0 && d < 128) {
+        /* newer packet, larger jumps are a resync and not losses */
+        if (d < MAVLINK_SEQ_WINDOW) {
+            r->seen = (r->seen << d) | 1;
+            r->lost += d - 1;
+        } else {
+            r->seen = 1;
+        }
+        r->seq = seq;
+    } else {
+        d = r->seq - seq;
+        if (d < MAVLINK_SEQ_WINDOW && (r->seen & (1U << d)) == 0) {
+            /* late packet first seen on this channel */
+            r->seen |= 1U << d;
+            if (r->lost > 0)
+                r->lost--;
+        } else if (d < MAVLINK_SEQ_WINDOW && *crc == msg->checksum &&
+                    r->ttl[ch] != 0 && (u8) (seq - r->ch_seq[ch] - 1) < 127) {
+            dup = 1;
+        } else {
+            /* the channel went backwards or carries its own sequence
+               (autopilots may number each port apart): resync */
+            r->seq = seq;
+            r->seen = 1;
+        }
+    }
+    r->ch_seq[ch] = seq;
+
+    if (dup)
+        rx_stats[ch].dup++;
+    else
+        *crc = msg->checksum;
+    return dup;
+}
+
+static unsigned char mavlink_learn_route(unsigned char ch, mavlink_message_t *msg)
+{
+    struct mavlink_route_entry *r;
+    unsigned char i, dup;
     
     if (msg->sysid == 0 || (msg->sysid == config.mav.osd_sysid && msg->compid == MAV_COMP_ID_OSD))
-        return;
+        return 0;
 
-    for(i = 0; i < total_routes; i++) {
-        if (routes[i].sysid == msg->sysid && 
-            routes[i].compid == msg->compid &&
-            routes[i].ch == ch) {
-            //if (routes[i].mavtype == 0 && msg->msgid == MAVLINK_MSG_ID_HEARTBEAT) {
-            //    routes[i].mavtype = mavlink_msg_heartbeat_get_type(msg);
-            //}
+    i = mavlink_route_hash(msg->sysid);
+    while (routes[i].ch_mask != 0) {
+        if (routes[i].sysid == msg->sysid && routes[i].compid == msg->compid)
             break;
-        }
+        i = (i + 1) & (MAVLINK_ROUTE_SLOTS - 1);
     }
-    if (i == total_routes && i < MAX_MAVLINK_ROUTES) {
-        routes[i].sysid = msg->sysid;
-        routes[i].compid = msg->compid;
-        routes[i].ch = ch;
-        //if (msg->msgid == MAVLINK_MSG_ID_HEARTBEAT) {
-        //    routes[i].mavtype = mavlink_msg_heartbeat_get_type(msg);
-        //}
+
+    r = &routes[i];
+    if (r->ch_mask == 0) {
+        if (total_routes == MAX_MAVLINK_ROUTES) {
+            mavlink_evict_route();
+            /* the probe run may have changed */
+            return mavlink_learn_route(ch, msg);
+        }
+        memset(r, 0, sizeof(struct mavlink_route_entry));
+        r->sysid = msg->sysid;
+        r->compid = msg->compid;
         total_routes++;
 #ifdef ROUTING_DEBUG
         shell_printf("learned route %u %u via %u\n",
@@ -347,21 +566,84 @@ static void mavlink_learn_route(unsigned char ch, mavlink_message_t *msg)
                  (unsigned)ch);
 #endif
     }
+    dup = mavlink_check_seq(r, ch, msg);
+    r->ch_mask |= 1 << ch;
+    r->ttl[ch] = MAVLINK_ROUTE_TTL;
+    r->packets++;
+    r->bytes += msg->len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+    return dup;
 }
 
+static void mavlink_age_routes(struct timer *t, void *d)
+{
+    struct mavlink_route_entry *r;
+    unsigned char i = 0, c;
+
+    while (i < MAVLINK_ROUTE_SLOTS) {
+        r = &routes[i];
+        if (r->ch_mask == 0) {
+            i++;
+            continue;
+        }
+        for (c = 0; c < MAVLINK_COMM_NUM_BUFFERS; c++) {
+            if ((r->ttl[c] != 0) && (--(r->ttl[c]) == 0))
+                r->ch_mask &= ~(1 << c);
+        }
+        /* a shifted entry lands on this slot, check it again */
+        if (r->ch_mask == 0)
+            mavlink_del_route(i);
+        else
+            i++;
+    }
+}
+
+static void mavlink_link_rates(struct timer *t, void *d)
+{
+    struct mavlink_rx_stats *s;
+    struct mavlink_route_entry *r;
+    u16 lost;
+    unsigned char i;
+
+    for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
+        s = &rx_stats[i];
+        s->pps = s->packets - s->last_packets;
+        s->bps = (u16) s->bytes - s->last_bytes;
+        lost = s->lost - s->last_lost;
+        s->quality = (s->pps + lost) ? ((u32) s->pps * 100) / (s->pps + lost) : 0;
+        s->last_packets = s->packets;
+        s->last_bytes = (u16) s->bytes;
+        s->last_lost = s->lost;
+    }
+
+    for (i = 0; i < MAVLINK_ROUTE_SLOTS; i++) {
+        r = &routes[i];
+        if (r->ch_mask == 0)
+            continue;
+        r->pps = r->packets - r->last_packets;
+        r->bps = (u16) r->bytes - r->last_bytes;
+        r->last_packets = r->packets;
+        r->last_bytes = (u16) r->bytes;
+    }
+}
+
+u8 mavlink_link_quality(u8 ch)
+{
+    if (ch >= MAVLINK_COMM_NUM_BUFFERS)
+        return 0;
+    return rx_stats[ch].quality;
+}
 
 static unsigned char mavlink_get_route(unsigned char ch, mavlink_message_t *msg)
 {
     int target_sys, target_comp;
     unsigned char i, route = active_channel_mask;
+    unsigned char sys_route;
+    unsigned char other = ~(ch < MAVLINK_COMM_NUM_BUFFERS ? (1 << ch) : 0);
 
     /* if the message wasn't generated by us
-     * mask out source channel 
-     * and learn the route */
-    if (ch != 255) {
+     * mask out source channel */
+    if (ch != 255)
         route &= ~(1 << ch);
-        mavlink_learn_route(ch, msg);
-    }
 
     /* heartbeats goes to all channels except origin */
     if (msg->msgid == MAVLINK_MSG_ID_HEARTBEAT)
@@ -377,28 +659,24 @@ static unsigned char mavlink_get_route(unsigned char ch, mavlink_message_t *msg)
     if (target_sys <= 0)
         return route;
 
-    /* selective routing - try match sysid and compid */
+    /* selective routing - try match sysid and compid,
+       else any route that match the sysid */
     route = 0;
-    for (i = 0; i < total_routes; i++) {
-        if (target_sys == routes[i].sysid &&
-                    (target_comp <= 0 || target_comp == routes[i].compid) &&
-                    routes[i].ch != ch) {
-            route |= 1 << routes[i].ch;
+    sys_route = 0;
+    i = mavlink_route_hash(target_sys);
+    while (routes[i].ch_mask != 0) {
+        if (target_sys == routes[i].sysid) {
+            sys_route |= routes[i].ch_mask;
+            if (target_comp <= 0 || target_comp == routes[i].compid)
+                route |= routes[i].ch_mask;
         }
+        i = (i + 1) & (MAVLINK_ROUTE_SLOTS - 1);
     }
-    /* mask out inactive channels */
-    route &= active_channel_mask;
+    /* mask out source and inactive channels */
+    route &= other & active_channel_mask;
     if (route)
         return route;
-
-    /* try forwarding to any route that match the sysid */
-    route = 0;
-    for (i = 0; i < total_routes; i++) {
-        if (target_sys == routes[i].sysid && routes[i].ch != ch) {
-            route |= 1 << routes[i].ch;
-        }
-    }
-    return route & active_channel_mask;
+    return sys_route & other & active_channel_mask;
 }
 
 void mavlink_send_msg(mavlink_message_t *msg)
@@ -407,25 +685,135 @@ void mavlink_send_msg(mavlink_message_t *msg)
     mavlink_send_msg_to_channels(route, msg);
 }
 
+/* take len bytes from the channel budget, low priority traffic
+   leaves the upper half of the bucket to normal traffic */
+static unsigned char mavlink_fwd_budget(unsigned char ch, u16 len, unsigned char low)
+{
+    struct mavlink_fwd_state *s = &fwd_state[ch];
+    u16 budget = config.mav.fwd[ch].budget;
+    u16 now = get_millis16(), cap, dt;
+    u32 add;
+
+    if (budget == 0)
+        return 1;
+
+    /* up to 200ms of traffic in a burst */
+    cap = max(budget / 5, MAVLINK_MAX_PACKET_LEN);
+    dt = now - s->refill;
+    add = ((u32) budget * dt) / 1000;
+    if (add > 0) {
+        s->tokens = (u16) min((u32) s->tokens + add, cap);
+        s->refill = now;
+    }
+
+    if (low && (s->tokens < (cap / 2)))
+        return 0;
+    if (s->tokens < len)
+        return 0;
+    s->tokens -= len;
+    return 1;
+}
+
+/* per channel forwarding policy for routed messages */
+static unsigned char mavlink_fwd_filter(unsigned char ch_mask, mavlink_message_t *msg)
+{
+    struct mavlink_fwd_config *f;
+    struct mavlink_fwd_state *s;
+    u16 len = msg->len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+    u16 now = get_millis16();
+    unsigned char i, r, low, ch_out = ch_mask;
+
+    for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
+        if ((ch_mask & (1 << i)) == 0)
+            continue;
+
+        f = &config.mav.fwd[i];
+        s = &fwd_state[i];
+
+        /* commands and heartbeats are never held back */
+        if (mavlink_tx_prio(msg->msgid)) {
+            tx_stats[i].fwd++;
+            continue;
+        }
+
+        for (r = 0; r < MAVLINK_FWD_RULES; r++) {
+            if ((f->id[r] == msg->msgid) && ((f->id[r] != 0) || (f->rate[r] != 0)))
+                break;
+        }
+
+        low = 0;
+        if (r < MAVLINK_FWD_RULES) {
+            if (f->rate[r] == 0) {
+                tx_stats[i].filtered++;
+                ch_out &= ~(1 << i);
+                continue;
+            }
+            if ((u16) (now - s->last[r]) < (1000 / f->rate[r])) {
+                tx_stats[i].shaped++;
+                ch_out &= ~(1 << i);
+                continue;
+            }
+            /* rate capped messages are bulk traffic */
+            low = 1;
+        } else if (f->mode == MAVLINK_FWD_LISTED) {
+            tx_stats[i].filtered++;
+            ch_out &= ~(1 << i);
+            continue;
+        }
+
+        if (!mavlink_fwd_budget(i, len, low)) {
+            tx_stats[i].shaped++;
+            ch_out &= ~(1 << i);
+            continue;
+        }
+
+        if (r < MAVLINK_FWD_RULES)
+            s->last[r] = now;
+        tx_stats[i].fwd++;
+    }
+    return ch_out;
+}
+
 void mavlink_handle_msg(unsigned char ch, mavlink_message_t *msg)
 {
     struct mavlink_callback *c;
-    unsigned char i, route;
+    unsigned char i, route, dup;
 
     LED = ~LED;
     
-    route = mavlink_get_route(ch, msg);
-    if (route)
-        mavlink_send_msg_to_channels(route, msg);
+    dup = mavlink_learn_route(ch, msg);
+    if (dup && (config.mav.dedup == MAVLINK_DEDUP_OFF))
+        dup = 0;
+
+    if (!dup || (config.mav.dedup != MAVLINK_DEDUP_ALL)) {
+        route = mavlink_get_route(ch, msg);
+        if (route)
+            route = mavlink_fwd_filter(route, msg);
+        if (route)
+            mavlink_send_msg_to_channels(route, msg);
+    }
+
+    if (dup) {
+        LED = ~LED;
+        return;
+    }
 
     if (msg->sysid == config.mav.uav_sysid)
         mavdata_store(msg);
     
-    for (i = 0; i < nr_callbacks; i++) {
-        c = &callbacks[i];
+    i = callback_msgid[msg->msgid];
+    while (i != 0) {
+        c = &callbacks[i - 1];
+        /* the callback may remove itself */
+        i = c->next;
+        /* a previous callback may have removed this slot, its next
+           link is kept; a slot reused for another msgid is in
+           another chain */
         if (c->cbk == NULL)
             continue;
-        if ((msg->msgid == c->msgid) && ((msg->sysid == c->sysid) || (c->sysid == MAV_SYS_ID_ANY)))
+        if (c->msgid != msg->msgid)
+            break;
+        if ((msg->sysid == c->sysid) || (c->sysid == MAV_SYS_ID_ANY))
             c->cbk(msg, c->data);
     }
     
@@ -439,7 +827,12 @@ static unsigned int mavlink_receive(struct uart_client *cli, unsigned char *buf,
     unsigned int i = len;
     while (i--) {
         if (mavlink_parse_char(cli->ch, *(buf++), &msg, &status)) {
+            rx_stats[cli->ch].packets++;
+            rx_stats[cli->ch].bytes += msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
             mavlink_handle_msg(cli->ch, &msg);
+        } else if (status.packet_rx_drop_count) {
+            /* parse errors of this byte (bad crc) */
+            rx_stats[cli->ch].crc++;
         }
     }
     return len;
@@ -447,12 +840,21 @@ static unsigned int mavlink_receive(struct uart_client *cli, unsigned char *buf,
 
 void mavlink_process_ch(u8 ch)
 {
-    u16 len = mavlink_uart_clients[ch].avail();
-    u8 buf[len];
-    
-    if (len > 0) {
-        mavlink_uart_clients[ch].read(buf, len);
-        mavlink_receive(&mavlink_uart_clients[ch], buf, len);
+    struct uart_client *cli = &mavlink_uart_clients[ch];
+    unsigned char *buf;
+    u16 len;
+    u8 seg;
+
+    /* parse straight from the rx ring, at most the two
+       segments of a wrapped buffer per call */
+    for (seg = 0; seg < 2; seg++) {
+        len = cli->peek(&buf);
+        if (len == 0)
+            break;
+        mavlink_receive(cli, buf, len);
+        /* the port was taken by the shell meanwhile */
+        if (cli->release(len) != len)
+            break;
     }
 }
 
@@ -483,15 +885,16 @@ static void mavlink_unset_active_channels(struct uart_client *cli)
 {
     u8 i = 0;
     /* remove channel from routing table */
-    while (i < total_routes) {
-        if (routes[i].ch == cli->ch) {
-            total_routes--;
-            if (total_routes > 0)
-                memcpy(&routes[i], &routes[i+1],
-                        sizeof(struct mavlink_route_entry) * (total_routes - i));
-        } else {
-            i++;
+    while (i < MAVLINK_ROUTE_SLOTS) {
+        if (routes[i].ch_mask & (1 << cli->ch)) {
+            routes[i].ch_mask &= ~(1 << cli->ch);
+            routes[i].ttl[cli->ch] = 0;
+            if (routes[i].ch_mask == 0) {
+                mavlink_del_route(i);
+                continue;
+            }
         }
+        i++;
     }
     active_channel_mask &= ~(1 << (cli->ch));
     
@@ -520,6 +923,11 @@ struct mavlink_callback* add_mavlink_callback_sysid(unsigned char sysid, unsigne
     c->data = data;
     if (i == nr_callbacks)
         nr_callbacks++;
+
+    c->next = callback_msgid[msgid];
+    callback_msgid[msgid] = i + 1;
+    c->type_next = callback_type[ctype];
+    callback_type[ctype] = i + 1;
     return c;
 }
 
@@ -529,21 +937,50 @@ inline struct mavlink_callback* add_mavlink_callback(unsigned char msgid,
     return add_mavlink_callback_sysid(config.mav.uav_sysid, msgid, cbk, ctype, data);
 }
 
+/* unlink from both chains, the slot keeps its next pointers
+   so a dispatch loop standing on it can carry on */
+void del_mavlink_callback(struct mavlink_callback *c)
+{
+    unsigned char idx = (c - callbacks) + 1;
+    unsigned char *p;
+
+    if (c->cbk == NULL)
+        return;
+
+    for (p = &callback_msgid[c->msgid]; *p != 0; p = &callbacks[*p - 1].next) {
+        if (*p == idx) {
+            *p = c->next;
+            break;
+        }
+    }
+    for (p = &callback_type[c->type]; *p != 0; p = &callbacks[*p - 1].type_next) {
+        if (*p == idx) {
+            *p = c->type_next;
+            break;
+        }
+    }
+    c->cbk = NULL;
+}
+
 void del_mavlink_callbacks(unsigned char ctype)
 {
-    struct mavlink_callback *c = callbacks;
     unsigned char i;
 
-    for (i = 0; i < nr_callbacks; i++) {
-        if (c->type == ctype)
-            c->cbk = NULL;
-        c++;
-    }
+    while ((i = callback_type[ctype]) != 0)
+        del_mavlink_callback(&callbacks[i - 1]);
 }
 
-void inline del_mavlink_callback(struct mavlink_callback *c)
+void del_mavlink_callbacks_data(unsigned char ctype, void *data)
 {
-    c->cbk = NULL;
+    struct mavlink_callback *c;
+    unsigned char i = callback_type[ctype];
+
+    while (i != 0) {
+        c = &callbacks[i - 1];
+        i = c->type_next;
+        if (c->data == data)
+            del_mavlink_callback(c);
+    }
 }
 
 static void mav_heartbeat(struct timer *t, void *d)
@@ -574,25 +1011,104 @@ static void mav_heartbeat_blink(struct timer *t, void *d)
     LED = ~LED;
 }
 
-static void send_param_list_cbk(struct timer *t, void *d)
+static void mavlink_send_param(unsigned int idx)
 {
     mavlink_message_t msg;
     float param_value;
     char param_name[17];
 
-    if (pidx == total_params) {
-        console_printf("send param end\n", pidx);
-        remove_timer(t);
-        return;
-    }
-
-    param_value = params_get_value(pidx, param_name);
+    param_value = params_get_value(idx, param_name);
     mavlink_msg_param_value_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
                                     param_name, param_value, MAVLINK_TYPE_FLOAT,
-                                    total_params, pidx++);
+                                    total_params, idx);
     mavlink_send_msg(&msg);
 }
 
+/* streaming rate (bytes/s) from the slowest active link */
+static u16 mavlink_param_rate(void)
+{
+    struct uart_client *cli;
+    u32 rate = 0xffff, baud;
+    u8 load = TRIM(config.mav.param_load, 10, 100);
+    unsigned char i;
+
+    for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
+        if ((active_channel_mask & (1 << i)) == 0)
+            continue;
+        cli = &mavlink_uart_clients[i];
+        /* 10 bits per byte */
+        baud = uart_get_baudrate(config.uart[cli->port].baudrate) / 10;
+        if (baud == 0) {
+            /* unknown speed, the fixed rate used before pacing */
+            rate = min(rate, PARAM_VALUE_LEN * 20);
+            continue;
+        }
+        rate = min(rate, (baud * load) / 100);
+    }
+    return (u16) max(rate, PARAM_VALUE_LEN * 10);
+}
+
+/* a param value goes to every active link, all must have room */
+static unsigned char mavlink_param_room(void)
+{
+    unsigned char i;
+
+    for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
+        if ((active_channel_mask & (1 << i)) == 0)
+            continue;
+        if (mavlink_uart_clients[i].tx_room() < PARAM_VALUE_LEN)
+            return 0;
+    }
+    return 1;
+}
+
+static void mavlink_param_stream(struct timer *t, void *d)
+{
+    struct param_stream *ps = &pstream;
+    u16 now = get_millis16(), rate, cap;
+    unsigned int idx;
+    u32 add;
+
+    /* burst up to 50ms of traffic per tick */
+    rate = mavlink_param_rate();
+    cap = max(rate / 20, PARAM_VALUE_LEN);
+    add = ((u32) rate * (u16) (now - ps->refill)) / 1000;
+    if (add > 0) {
+        ps->tokens = (u16) min((u32) ps->tokens + add, cap);
+        ps->refill = now;
+    }
+
+    while ((ps->tokens >= PARAM_VALUE_LEN) && mavlink_param_room()) {
+        if (ps->q_len > 0) {
+            /* missing params first */
+            idx = ps->queue[ps->q_rd];
+            ps->q_rd = (ps->q_rd + 1) & (PARAM_QUEUE_SIZE - 1);
+            ps->q_len--;
+        } else if (ps->next < ps->total) {
+            idx = ps->next++;
+            if (ps->next == ps->total)
+                console_printf("send param end %ums\n", now - ps->start);
+        } else {
+            break;
+        }
+        mavlink_send_param(idx);
+        ps->tokens -= PARAM_VALUE_LEN;
+    }
+
+    if ((ps->q_len == 0) && (ps->next >= ps->total)) {
+        remove_timer(t);
+        ps->timer = NULL;
+    }
+}
+
+static void mavlink_param_stream_start(void)
+{
+    if (pstream.timer != NULL)
+        return;
+    pstream.tokens = 0;
+    pstream.refill = get_millis16();
+    pstream.timer = add_timer(TIMER_ALWAYS, PARAM_STREAM_TICK, mavlink_param_stream, NULL);
+}
 
 void mav_param_request_list(mavlink_message_t *msg, void *d)
 {
@@ -605,9 +1121,12 @@ void mav_param_request_list(mavlink_message_t *msg, void *d)
     if (sys != config.mav.osd_sysid)
         return;
     
-    pidx = 0;
+    /* a new request restarts the list */
     total_params = params_get_total();
-    add_timer(TIMER_ALWAYS, 50, send_param_list_cbk, d);
+    pstream.next = 0;
+    pstream.total = total_params;
+    pstream.start = get_millis16();
+    mavlink_param_stream_start();
 
     console_printf("plist:sysid=%d compid=%d\n", sys, comp);
 }
@@ -615,7 +1134,8 @@ void mav_param_request_list(mavlink_message_t *msg, void *d)
 
 void mav_param_request_read(mavlink_message_t *msg, void *d)
 {
-    unsigned char sys, comp;
+    struct param_stream *ps = &pstream;
+    unsigned char sys, comp, i;
     mavlink_message_t msg2;
     char param_name[17];
     float param_value;
@@ -627,10 +1147,25 @@ void mav_param_request_read(mavlink_message_t *msg, void *d)
     if ((comp != MAV_COMP_ID_OSD) || (sys != config.mav.osd_sysid))
         return;
 
+    if (total_params == 0)
+        total_params = params_get_total();
+
     idx = mavlink_msg_param_request_read_get_param_index(msg);
     if (idx == -1) {
         mavlink_msg_param_request_read_get_param_id(msg, param_name);
         param_name[16]= '\0';
+    } else {
+        /* missing params of a list are paced along with it */
+        for (i = 0; i < ps->q_len; i++) {
+            if (ps->queue[(ps->q_rd + i) & (PARAM_QUEUE_SIZE - 1)] == idx)
+                return;
+        }
+        if (ps->q_len < PARAM_QUEUE_SIZE) {
+            ps->queue[(ps->q_rd + ps->q_len) & (PARAM_QUEUE_SIZE - 1)] = idx;
+            ps->q_len++;
+            mavlink_param_stream_start();
+            return;
+        }
     }
 
     param_value = params_get_value(idx, param_name);
@@ -746,6 +1281,7 @@ void mavlink_init(void)
     /* register module parameters */
     params_add(params_mavlink);
     params_add(params_mavlink_rates);
+    params_add(params_mavlink_fwd);
 
     /* LED heartbeat timer */
     t = add_timer(TIMER_ALWAYS, 1000, mav_heartbeat_blink, NULL);
@@ -767,6 +1303,11 @@ void mavlink_init(void)
     add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_PARAM_SET,
                 mav_param_set, CALLBACK_PERSISTENT, NULL);
 
+    /* expire routes of components that went silent */
+    add_timer(TIMER_ALWAYS, 1000, mavlink_age_routes, NULL);
+    /* link quality */
+    add_timer(TIMER_ALWAYS, 1000, mavlink_link_rates, NULL);
+
     /* request stream rates periodically */
     add_timer(TIMER_ALWAYS, 60000, mavlink_request_data_streams, NULL);
     
@@ -803,24 +1344,66 @@ static void shell_cmd_stats(char *args, void *data)
         shell_printf(" buffer_overrun=%u\n", status->buffer_overrun);
         shell_printf(" packet_rx_drop_count=%u\n", status->packet_rx_drop_count);
         shell_printf(" packet_rx_success_count=%u\n", status->packet_rx_success_count);
+        shell_printf(" packet_tx_count=%u\n", tx_stats[i].sent);
+        shell_printf(" packet_tx_drop_count=%u\n", tx_stats[i].dropped);
+        shell_printf(" routed: forwarded=%u filtered=%u shaped=%u\n",
+                    tx_stats[i].fwd, tx_stats[i].filtered, tx_stats[i].shaped);
+        shell_printf(" packet_lost_count=%u duplicates=%u\n",
+                    rx_stats[i].lost, rx_stats[i].dup);
     }
     shell_printf("\nActive channel mask=%x\n", active_channel_mask);
     shell_printf("\nUAV last seen %lums ago\n", mavdata_age(MAVLINK_MSG_ID_HEARTBEAT));
 }
 
-static void shell_cmd_route(char *args, void *data)
+static void shell_cmd_link(char *args, void *data)
 {
+    struct mavlink_rx_stats *s;
+    struct mavlink_route_entry *r;
     unsigned char i;
+
+    shell_printf("Mavlink links:\n");
+    shell_printf(" ch quality  pkt/s  bytes/s   packets      lost  crc  dup\n");
+    for (i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++) {
+        if ((active_channel_mask & (1 << i)) == 0)
+            continue;
+        s = &rx_stats[i];
+        shell_printf(" %2u %6u%% %6u %8u %9u %9u %4u %4u\n", i,
+                s->quality, s->pps, s->bps, s->packets, s->lost, s->crc, s->dup);
+    }
+
+    shell_printf("\nSources:\n");
+    shell_printf(" sysid compid  pkt/s  bytes/s   packets      lost\n");
+    for (i = 0; i < MAVLINK_ROUTE_SLOTS; i++) {
+        r = &routes[i];
+        if (r->ch_mask == 0)
+            continue;
+        shell_printf(" %5u %6u %6u %8u %9u %9u\n",
+                (unsigned) r->sysid, (unsigned) r->compid,
+                r->pps, r->bps, r->packets, r->lost);
+    }
+}
+
+static void shell_cmd_route(char *args, void *data)
+{
+    struct mavlink_route_entry *r;
+    unsigned char i, c;
     
     shell_printf("Mavlink routing table:\n");
-    for(i = 0; i < total_routes; i++) {
-        shell_printf(" sysid(%3u) compid(%3u) on channel(%u)\n",
-                (unsigned) routes[i].sysid, 
-                (unsigned) routes[i].compid,
-                (unsigned) routes[i].ch);
+    for(i = 0; i < MAVLINK_ROUTE_SLOTS; i++) {
+        r = &routes[i];
+        if (r->ch_mask == 0)
+            continue;
+        shell_printf(" sysid(%3u) compid(%3u) channels(",
+                (unsigned) r->sysid, (unsigned) r->compid);
+        for (c = 0; c < MAVLINK_COMM_NUM_BUFFERS; c++) {
+            if (r->ch_mask & (1 << c))
+                shell_printf(" %u:%us", c, r->ttl[c]);
+        }
+        shell_printf(" ) packets=%u bytes=%lu\n", r->packets, r->bytes);
     }
     
-    shell_printf("\ntotal routes=%d max=%d\n", total_routes, MAX_MAVLINK_ROUTES);
+    shell_printf("\ntotal routes=%d max=%d evicted=%u\n",
+            total_routes, MAX_MAVLINK_ROUTES, evicted_routes);
 }
 
 #define SHELL_CMD_MAVRATE_ARGS    2
@@ -981,6 +1564,7 @@ static const struct shell_cmdmap_s mavlink_cmdmap[] = {
     {"callbacks", shell_cmd_callbacks, "Display callback info", SHELL_CMD_SIMPLE},
     {"config", shell_cmd_config, "Config mavlink parameters", SHELL_CMD_SIMPLE},
     {"rates", shell_cmd_rates, "Mavlink stream rates", SHELL_CMD_SIMPLE},
+    {"link", shell_cmd_link, "Display link quality", SHELL_CMD_SIMPLE},
     {"route", shell_cmd_route, "Display routing table", SHELL_CMD_SIMPLE},
     {"stats", shell_cmd_stats, "Display statistics", SHELL_CMD_SIMPLE},
     {"watch", shell_cmd_watch, "Watch messages", SHELL_CMD_SIMPLE},
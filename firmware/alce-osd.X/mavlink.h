@@ -25,11 +25,43 @@
 #define MAV_SYS_ID_ANY          (0)
 #define MAV_TYPE_ALCEOSD        (MAV_TYPE_ONBOARD_CONTROLLER)
 
+#define MAVLINK_FWD_RULES       (4)
+
+enum {
+    MAVLINK_FWD_ALL = 0,
+    /* only heartbeats and the msgids in the rules are forwarded */
+    MAVLINK_FWD_LISTED,
+};
+
+/* forwarding policy of a channel */
+struct mavlink_fwd_config {
+    u8 mode;
+    /* bytes/s for routed traffic, 0=unlimited */
+    u16 budget;
+    /* msgid rules: rate is the max forwarding rate (Hz), 0=blocked */
+    u8 id[MAVLINK_FWD_RULES];
+    u8 rate[MAVLINK_FWD_RULES];
+};
+
+enum {
+    MAVLINK_DEDUP_OFF = 0,
+    /* duplicates are not decoded nor dispatched */
+    MAVLINK_DEDUP_LOCAL,
+    /* duplicates are not forwarded either */
+    MAVLINK_DEDUP_ALL,
+};
+
 struct mavlink_config {
     unsigned char streams[8];
     unsigned char uav_sysid, osd_sysid;
     unsigned char heartbeat;
     u8 shell_rate;
+    u8 dedup;
+    /* share of the slowest link used for param streaming (%) */
+    u8 param_load;
+    /* seconds between mission count checks, 0 disables them */
+    u8 mission_poll;
+    struct mavlink_fwd_config fwd[MAVLINK_COMM_NUM_BUFFERS];
 };
 
 struct mavlink_callback {
@@ -38,6 +70,8 @@ struct mavlink_callback {
     unsigned char type;
     void *data;
     void (*cbk) (mavlink_message_t *msg, void *data);
+    /* chains by msgid and by type (slot+1, 0=end) */
+    unsigned char next, type_next;
 };
 
 
@@ -48,9 +82,11 @@ struct mavlink_callback* add_mavlink_callback_sysid(unsigned char sysid,
         unsigned char msgid,
         void *cbk, unsigned char ctype, void *data);
 void del_mavlink_callbacks(unsigned char ctype);
+void del_mavlink_callbacks_data(unsigned char ctype, void *data);
 void mavlink_handle_msg(unsigned char ch, mavlink_message_t *msg);
 void mavlink_send_msg(mavlink_message_t *msg);
 void mavlink_get_targets(mavlink_message_t *msg, int *sysid, int *compid);
+u8 mavlink_link_quality(u8 ch);
 
 void shell_cmd_mavlink(char *args, void *data);
 
@@ -63,6 +99,7 @@ enum {
     CALLBACK_PERSISTENT,
     CALLBACK_HOME_INIT,
     CALLBACK_WATCH,
+    CALLBACK_TYPES,
 };
 
 enum {
@@ -0,0 +1,410 @@
+/*
+    AlceOSD - Graphical OSD
+    Copyright (C) 2015  Luis Alves
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alce-osd.h"
+
+#define MISSION_PACE        (50)    /* ms between item requests */
+#define MISSION_TIMEOUT     (1000)  /* ms to wait for an answer */
+#define MISSION_RETRIES     (5)
+
+/* 1e-7 deg to meters */
+#define E7_TO_M             (DEG2RAD(1e-7) * EARTH_RADIUS)
+
+extern struct alceosd_config config;
+
+static struct mission_data mission;
+
+static struct mission_priv {
+    u16 last_req;
+    u32 last_poll;
+    u8 retries, pending, refresh, force;
+    /* home waypoint, kept apart from the table (1e7 deg, m) */
+    s32 wp0_lat, wp0_lon;
+    s16 wp0_alt;
+    u8 wp0_valid;
+    /* metric scale of the longitude at the origin */
+    float lon_scale;
+
+    u16 downloads, items, timeouts;
+} priv;
+
+
+struct mission_data* get_mission_data(void)
+{
+    return &mission;
+}
+
+static void send_request_list(void)
+{
+    mavlink_message_t msg;
+
+    mavlink_msg_mission_request_list_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
+                        config.mav.uav_sysid, MAV_COMP_ID_ALL);
+    mavlink_send_msg(&msg);
+    priv.last_req = get_millis16();
+}
+
+static void send_request_item(u16 seq)
+{
+    mavlink_message_t msg;
+
+#ifdef MAVLINK_MSG_ID_MISSION_REQUEST_INT
+    mavlink_msg_mission_request_int_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
+                        config.mav.uav_sysid, MAV_COMP_ID_ALL, seq);
+#else
+    mavlink_msg_mission_request_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
+                        config.mav.uav_sysid, MAV_COMP_ID_ALL, seq);
+#endif
+    mavlink_send_msg(&msg);
+    priv.last_req = get_millis16();
+}
+
+static void send_ack(void)
+{
+    mavlink_message_t msg;
+
+    mavlink_msg_mission_ack_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
+                        config.mav.uav_sysid, MAV_COMP_ID_ALL, MAV_MISSION_ACCEPTED);
+    mavlink_send_msg(&msg);
+}
+
+static void mission_clear(void)
+{
+    mission.total = 0;
+    mission.valid = 0;
+    mission.seq = 0;
+}
+
+/* check the mission count, the table is kept until it differs */
+void mission_refresh(void)
+{
+    priv.refresh = 1;
+}
+
+/* download the mission again even if the count did not change */
+static void mission_reload(void)
+{
+    priv.force = 1;
+    priv.refresh = 1;
+}
+
+/* ask the uav for the home waypoint alone, the table is left untouched */
+void mission_request_wp0(void)
+{
+    priv.wp0_valid = 0;
+    if (mission.state == MISSION_IDLE)
+        send_request_item(0);
+}
+
+/* 0 when the home waypoint (seq 0) is known */
+int mission_get_wp0(struct gps_coord *c, s16 *alt)
+{
+    if (!priv.wp0_valid)
+        return -1;
+
+    c->lat = DEG2RAD(priv.wp0_lat / 10000000.0);
+    c->lon = DEG2RAD(priv.wp0_lon / 10000000.0);
+    *alt = priv.wp0_alt;
+    return 0;
+}
+
+static void mission_store_wp0(mavlink_message_t *msg, s32 lat, s32 lon, float z)
+{
+    int sysid, compid;
+
+    if (msg->sysid != config.mav.uav_sysid)
+        return;
+    mavlink_get_targets(msg, &sysid, &compid);
+    if (sysid != config.mav.osd_sysid)
+        return;
+
+    /* no home yet */
+    if ((lat == 0) && (lon == 0))
+        return;
+
+    priv.wp0_lat = lat;
+    priv.wp0_lon = lon;
+    priv.wp0_alt = (s16) z;
+    priv.wp0_valid = 1;
+}
+
+/* position of the table origin in meters from c (east, north) */
+int mission_get_offset(struct gps_coord *c, struct point *p)
+{
+    s32 lat, lon;
+
+    if (mission.total == 0)
+        return -1;
+
+    lat = (s32) (RAD2DEG(c->lat) * 10000000.0);
+    lon = (s32) (RAD2DEG(c->lon) * 10000000.0);
+    p->x = (int) ((mission.lon0 - lon) * priv.lon_scale);
+    p->y = (int) ((mission.lat0 - lat) * E7_TO_M);
+    return 0;
+}
+
+static void mission_store(u16 seq, u16 cmd, s32 lat, s32 lon, float z)
+{
+    struct point *p;
+    float x, y;
+
+    /* only navigation commands with a position are drawn */
+    if ((cmd > MAV_CMD_NAV_LAST) || ((lat == 0) && (lon == 0)))
+        return;
+    if (mission.total == MAX_MISSION_WP)
+        return;
+
+    if (mission.total == 0) {
+        mission.lat0 = lat;
+        mission.lon0 = lon;
+        mission.alt0 = (s16) z;
+        mission.seq0 = seq;
+        priv.lon_scale = E7_TO_M * cos(DEG2RAD(lat / 10000000.0));
+    }
+
+    x = (lon - mission.lon0) * priv.lon_scale;
+    y = (lat - mission.lat0) * E7_TO_M;
+
+    p = &mission.pos[mission.total];
+    p->x = (int) TRIM(x, -32767, 32767);
+    p->y = (int) TRIM(y, -32767, 32767);
+    mission.alt[mission.total] = (s16) z;
+    mission.wp_seq[mission.total] = seq;
+    mission.total++;
+}
+
+static void mission_next(void)
+{
+    priv.items++;
+    priv.pending = 0;
+    priv.retries = 0;
+
+    if (++mission.seq < mission.count)
+        return;
+
+    send_ack();
+    mission.valid = 1;
+    mission.state = MISSION_IDLE;
+    priv.downloads++;
+}
+
+static unsigned char mission_item_for_us(mavlink_message_t *msg, int seq)
+{
+    int sysid, compid;
+
+    if ((mission.state != MISSION_WAIT_ITEM) || (msg->sysid != config.mav.uav_sysid))
+        return 0;
+
+    mavlink_get_targets(msg, &sysid, &compid);
+    return (sysid == config.mav.osd_sysid) && (seq == mission.seq);
+}
+
+static void mav_mission_item(mavlink_message_t *msg, void *d)
+{
+    mavlink_mission_item_t mi;
+
+    if (mavlink_msg_mission_item_get_seq(msg) == 0)
+        mission_store_wp0(msg, (s32) (mavlink_msg_mission_item_get_x(msg) * 10000000.0),
+                    (s32) (mavlink_msg_mission_item_get_y(msg) * 10000000.0),
+                    mavlink_msg_mission_item_get_z(msg));
+
+    if (!mission_item_for_us(msg, mavlink_msg_mission_item_get_seq(msg)))
+        return;
+
+    mavlink_msg_mission_item_decode(msg, &mi);
+    mission_store(mi.seq, mi.command, (s32) (mi.x * 10000000.0),
+                    (s32) (mi.y * 10000000.0), mi.z);
+    mission_next();
+}
+
+static void mav_mission_item_int(mavlink_message_t *msg, void *d)
+{
+    mavlink_mission_item_int_t mi;
+
+    if (mavlink_msg_mission_item_int_get_seq(msg) == 0)
+        mission_store_wp0(msg, mavlink_msg_mission_item_int_get_x(msg),
+                    mavlink_msg_mission_item_int_get_y(msg),
+                    mavlink_msg_mission_item_int_get_z(msg));
+
+    if (!mission_item_for_us(msg, mavlink_msg_mission_item_int_get_seq(msg)))
+        return;
+
+    mavlink_msg_mission_item_int_decode(msg, &mi);
+    mission_store(mi.seq, mi.command, mi.x, mi.y, mi.z);
+    mission_next();
+}
+
+static void mav_mission_count(mavlink_message_t *msg, void *d)
+{
+    int sysid, compid;
+    u16 count = mavlink_msg_mission_count_get_count(msg);
+
+    if (msg->sysid != config.mav.uav_sysid)
+        return;
+
+    mavlink_get_targets(msg, &sysid, &compid);
+    if (sysid != config.mav.osd_sysid) {
+        /* answer to someone else: check it against the table */
+        if (mission.valid && (count != mission.count))
+            mission_refresh();
+        return;
+    }
+
+    if (mission.state != MISSION_WAIT_COUNT)
+        return;
+
+    priv.retries = 0;
+    if (mission.valid && (count == mission.count) && !priv.force) {
+        /* nothing changed, end the transaction */
+        send_ack();
+        mission.state = MISSION_IDLE;
+        return;
+    }
+
+    priv.force = 0;
+    mission_clear();
+    mission.count = count;
+    if (count == 0) {
+        send_ack();
+        mission.valid = 1;
+        mission.state = MISSION_IDLE;
+    } else {
+        priv.pending = 0;
+        mission.state = MISSION_WAIT_ITEM;
+    }
+}
+
+static void mav_mission_ack(mavlink_message_t *msg, void *d)
+{
+    int sysid, compid;
+
+    if (msg->sysid != config.mav.uav_sysid)
+        return;
+
+    /* the uav accepted a mission upload from someone else */
+    mavlink_get_targets(msg, &sysid, &compid);
+    if (sysid != config.mav.osd_sysid)
+        mission_reload();
+}
+
+static void mission_timer(struct timer *t, void *d)
+{
+    u16 now = get_millis16();
+
+    switch (mission.state) {
+        case MISSION_IDLE:
+        default:
+            if (mavdata_age(MAVLINK_MSG_ID_HEARTBEAT) > 5000)
+                return;
+            if (!priv.refresh && ((config.mav.mission_poll == 0) ||
+                    ((get_millis() - priv.last_poll) < config.mav.mission_poll * 1000UL)))
+                return;
+
+            priv.refresh = 0;
+            priv.retries = 0;
+            priv.last_poll = get_millis();
+            send_request_list();
+            mission.state = MISSION_WAIT_COUNT;
+            break;
+        case MISSION_WAIT_COUNT:
+            if ((u16) (now - priv.last_req) < MISSION_TIMEOUT)
+                return;
+            if (++priv.retries > MISSION_RETRIES) {
+                priv.timeouts++;
+                mission.state = MISSION_IDLE;
+                return;
+            }
+            send_request_list();
+            break;
+        case MISSION_WAIT_ITEM:
+            /* one outstanding request, at most one per timer period */
+            if (!priv.pending) {
+                priv.pending = 1;
+            } else {
+                if ((u16) (now - priv.last_req) < MISSION_TIMEOUT)
+                    return;
+                if (++priv.retries > MISSION_RETRIES) {
+                    priv.timeouts++;
+                    mission_clear();
+                    mission.state = MISSION_IDLE;
+                    return;
+                }
+            }
+            send_request_item(mission.seq);
+            break;
+    }
+}
+
+void init_mission(void)
+{
+    memset(&mission, 0, sizeof(struct mission_data));
+    memset(&priv, 0, sizeof(struct mission_priv));
+    priv.refresh = 1;
+
+    /* the handlers follow the uav sysid, it may change at runtime */
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_MISSION_COUNT,
+                mav_mission_count, CALLBACK_PERSISTENT, NULL);
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_MISSION_ITEM,
+                mav_mission_item, CALLBACK_PERSISTENT, NULL);
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_MISSION_ITEM_INT,
+                mav_mission_item_int, CALLBACK_PERSISTENT, NULL);
+    add_mavlink_callback_sysid(MAV_SYS_ID_ANY, MAVLINK_MSG_ID_MISSION_ACK,
+                mav_mission_ack, CALLBACK_PERSISTENT, NULL);
+    add_timer(TIMER_ALWAYS, MISSION_PACE, mission_timer, NULL);
+}
+
+static void shell_cmd_stats(char *args, void *data)
+{
+    const char state[3][8] = {"idle", "count", "items"};
+    u8 i;
+
+    shell_printf("Mission state: %s (item %u/%u)\n", state[mission.state],
+                    mission.seq, mission.count);
+    shell_printf("Table: %s, %u waypoints\n",
+                    mission.valid ? "valid" : "incomplete", mission.total);
+    shell_printf("Downloads: %u items: %u timeouts: %u\n\n",
+                    priv.downloads, priv.items, priv.timeouts);
+
+    if (mission.total == 0)
+        return;
+
+    shell_printf("Origin: lat=%ld lon=%ld alt=%dm (seq %u)\n",
+                    mission.lat0, mission.lon0, mission.alt0, mission.seq0);
+    shell_printf(" seq |  east(m) | north(m) | alt(m)\n");
+    shell_printf("-----+----------+----------+-------\n");
+    for (i = 0; i < mission.total; i++)
+        shell_printf(" %3u | %8d | %8d | %5d\n", mission.wp_seq[i],
+                    mission.pos[i].x, mission.pos[i].y, mission.alt[i]);
+}
+
+static void shell_cmd_refresh(char *args, void *data)
+{
+    mission_reload();
+    shell_printf("Mission download scheduled\n");
+}
+
+static const struct shell_cmdmap_s mission_cmdmap[] = {
+    {"stats", shell_cmd_stats, "Mission stats", SHELL_CMD_SIMPLE},
+    {"refresh", shell_cmd_refresh, "Download the mission again", SHELL_CMD_SIMPLE},
+    {"", NULL, ""},
+};
+
+void shell_cmd_mission(char *args, void *data)
+{
+    shell_exec(args, mission_cmdmap, data);
+}
@@ -0,0 +1,55 @@
+/*
+    AlceOSD - Graphical OSD
+    Copyright (C) 2015  Luis Alves
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MISSION_H
+#define	MISSION_H
+
+#define MAX_MISSION_WP      (48)
+
+enum {
+    MISSION_IDLE = 0,
+    MISSION_WAIT_COUNT,
+    MISSION_WAIT_ITEM,
+};
+
+struct mission_data {
+    /* items on the uav and download progress */
+    u16 count, seq;
+    u8 state, valid;
+
+    /* origin of the table, first item with a position (1e7 deg, m) */
+    s32 lat0, lon0;
+    s16 alt0;
+    u16 seq0;
+
+    /* positional waypoints, offsets from the origin (east, north) in meters */
+    u8 total;
+    struct point pos[MAX_MISSION_WP];
+    s16 alt[MAX_MISSION_WP];
+    u16 wp_seq[MAX_MISSION_WP];
+};
+
+void init_mission(void);
+struct mission_data* get_mission_data(void);
+void mission_refresh(void);
+void mission_request_wp0(void);
+int mission_get_wp0(struct gps_coord *c, s16 *alt);
+int mission_get_offset(struct gps_coord *c, struct point *p);
+void shell_cmd_mission(char *args, void *data);
+
+#endif	/* MISSION_H */
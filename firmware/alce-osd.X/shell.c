@@ -114,6 +114,7 @@ static const struct shell_cmdmap_s root_cmdmap[] = {
     {"home", shell_cmd_home, "Home module", SHELL_CMD_SUBCMD},
     {"mavdata", shell_cmd_mavdata, "Mavlink data storage module", SHELL_CMD_SUBCMD},
     {"mavlink", shell_cmd_mavlink, "Mavlink module", SHELL_CMD_SUBCMD},
+    {"mission", shell_cmd_mission, "Mission module", SHELL_CMD_SUBCMD},
     {"process", shell_cmd_process, "Process module", SHELL_CMD_SUBCMD},
     {"reboot", shell_cmd_reboot, "Reboot AlceOSD", SHELL_CMD_SIMPLE},
     {"tabs", shell_cmd_tabs, "Tabs module", SHELL_CMD_SUBCMD},
@@ -163,7 +164,7 @@ inline static void _shell_write_uart(u8 *buf, u16 len)
     u8 *b = buf;
     int ret;
     do {
-        wr = min(UART_TX_BUF_SIZE, len);
+        wr = min(UART_TX_MAX_WRITE, len);
         do {
             ret = shell_uart_client.write(b, wr);
         } while (ret != 0);
@@ -179,7 +180,7 @@ void shell_write(u8 *buf, u16 len)
         _shell_write_mavlink(buf, len);
 }
 
-#define EDS_TMP_BUF_SIZE (UART_TX_BUF_SIZE)
+#define EDS_TMP_BUF_SIZE (128)
 void shell_write_eds(__eds__ unsigned char *buf, u16 len)
 {
     u8 _buf[EDS_TMP_BUF_SIZE];
@@ -212,7 +213,7 @@ int shell_printf(const char *fmt, ...)
     va_list ap;
 
     va_start(ap, fmt);
-    ret = vsprintf(buf, fmt, ap);
+    ret = vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
     if (ret > 0) {
         shell_puts(buf);
@@ -47,9 +47,9 @@ static const struct param_def params_tabs[] = {
 };
 
 static const struct widget_config tab0_widgets[] = {
-    { 0, 0, WIDGET_CONSOLE_ID,  0, 0, {JUST_TOP | JUST_LEFT}},
-    { 0, 0, WIDGET_VIDEOLVL_ID, 0, 0, {JUST_TOP | JUST_RIGHT}},
-    { TABS_END, 0, 0, 0, 0, {0}},
+    { 0, 0, WIDGET_CONSOLE_ID,  0, 0, 0, {JUST_TOP | JUST_LEFT}},
+    { 0, 0, WIDGET_VIDEOLVL_ID, 0, 0, 0, {JUST_TOP | JUST_RIGHT}},
+    { TABS_END, 0, 0, 0, 0, 0, {0}},
 };
 
 
@@ -78,26 +78,31 @@ void load_tab(unsigned char tab)
     /* stop rendering */
     video_pause();
 
-    /* reset widgets module */
-    widgets_reset();
-
-    /* default video profile */
-    video_apply_config(0);
-
     if (tab == 0) {
         w_cfg = (struct widget_config*) tab0_widgets;
     } else {
         w_cfg = config.widgets;
     }
 
-    /* load widgets config */
-    while (w_cfg->tab != TABS_END) {
-        if (w_cfg->tab == tab)
-            load_widget_config(w_cfg);
-        w_cfg++;
+    if ((tab != active_tab) && (video_get_profile() == 0)) {
+        /* keep widgets common to both tabs */
+        widgets_switch_tab(w_cfg, tab);
+    } else {
+        /* reset widgets module */
+        widgets_reset();
+
+        /* default video profile */
+        video_apply_config(0);
+
+        /* load widgets config */
+        while (w_cfg->tab != TABS_END) {
+            if (w_cfg->tab == tab)
+                load_widget_config(w_cfg);
+            w_cfg++;
+        }
+
+        load_widgets();
     }
-    
-    load_widgets();
 
     /* resume video rendering */
     video_resume();
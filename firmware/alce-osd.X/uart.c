@@ -29,6 +29,13 @@ const struct uart_regs {
     volatile unsigned int *RX;
     volatile unsigned int *STA;
     volatile unsigned int *MODE;
+    /* tx dma channel */
+    volatile unsigned int *DMACON;
+    volatile unsigned int *DMACNT;
+    volatile unsigned int *DMASTAL;
+    volatile unsigned int *DMAREQ;
+    volatile unsigned int *DMAIEC;
+    unsigned int DMAIE;
 } UARTS[] = {
     {
         .BRG = &U1BRG,
@@ -37,6 +44,12 @@ const struct uart_regs {
         .RX = &U1RXREG,
         .STA = &U1STA,
         .MODE = &U1MODE,
+        .DMACON = &DMA0CON,
+        .DMACNT = &DMA0CNT,
+        .DMASTAL = &DMA0STAL,
+        .DMAREQ = &DMA0REQ,
+        .DMAIEC = &IEC0,
+        .DMAIE = 1 << 4,
     },
     {
         .BRG = &U2BRG,
@@ -45,6 +58,12 @@ const struct uart_regs {
         .RX = &U2RXREG,
         .STA = &U2STA,
         .MODE = &U2MODE,
+        .DMACON = &DMA1CON,
+        .DMACNT = &DMA1CNT,
+        .DMASTAL = &DMA1STAL,
+        .DMAREQ = &DMA1REQ,
+        .DMAIEC = &IEC0,
+        .DMAIE = 1 << 14,
     },
     {
         .BRG = &U3BRG,
@@ -53,6 +72,12 @@ const struct uart_regs {
         .RX = &U3RXREG,
         .STA = &U3STA,
         .MODE = &U3MODE,
+        .DMACON = &DMA2CON,
+        .DMACNT = &DMA2CNT,
+        .DMASTAL = &DMA2STAL,
+        .DMAREQ = &DMA2REQ,
+        .DMAIEC = &IEC1,
+        .DMAIE = 1 << 8,
     },
     {
         .BRG = &U4BRG,
@@ -61,6 +86,12 @@ const struct uart_regs {
         .RX = &U4RXREG,
         .STA = &U4STA,
         .MODE = &U4MODE,
+        .DMACON = &DMA3CON,
+        .DMACNT = &DMA3CNT,
+        .DMASTAL = &DMA3STAL,
+        .DMAREQ = &DMA3REQ,
+        .DMAIEC = &IEC2,
+        .DMAIE = 1 << 4,
     },
 };
 
@@ -114,10 +145,15 @@ static struct uart_client *port_clients[4] = {NULL, NULL, NULL, NULL};
 struct uart_fifo_s {
     unsigned char buf[UART_FIFO_MASK+1];
     unsigned int rd, wr;
+    /* read position handed out by the last peek */
+    unsigned int peek_rd;
     unsigned int overflow, overrun, m, max;
     
+    /* tx ring, the dma interrupt drains it from tx_rd */
     __eds__ unsigned char *tx_buf;
-    unsigned int full;
+    unsigned int tx_dma, tx_mask;
+    volatile unsigned int tx_rd, tx_wr, tx_len;
+    unsigned int full, tx_max;
     
     u32 rx, tx;
 };
@@ -125,11 +161,11 @@ struct uart_fifo_s {
 static struct uart_fifo_s uart_fifo[4];
 
 
-/* tx dma buffers */
-__eds__ unsigned char tx_buf1[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(0x6000-UART_TX_BUF_SIZE)));
-__eds__ unsigned char tx_buf2[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(0x6000-(UART_TX_BUF_SIZE*2))));
-__eds__ unsigned char tx_buf3[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(0x6000-(UART_TX_BUF_SIZE*3))));
-__eds__ unsigned char tx_buf4[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(0x6000-(UART_TX_BUF_SIZE*4))));
+/* tx dma buffers, stacked down from scratchpad B (see videocore.h) */
+__eds__ unsigned char tx_buf1[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(SCRATCHPAD2_ADDR-UART_TX_BUF_SIZE)));
+__eds__ unsigned char tx_buf2[UART_TX_BUF_SIZE] __attribute__((eds,space(dma),address(SCRATCHPAD2_ADDR-(UART_TX_BUF_SIZE*2))));
+__eds__ unsigned char tx_buf3[UART_TX_BUF_SIZE_SMALL] __attribute__((eds,space(dma),address(SCRATCHPAD2_ADDR-(UART_TX_BUF_SIZE*2)-UART_TX_BUF_SIZE_SMALL)));
+__eds__ unsigned char tx_buf4[UART_TX_BUF_SIZE_SMALL] __attribute__((eds,space(dma),address(SCRATCHPAD2_ADDR-UART_TX_RAM_SIZE)));
 
 
 static const char keywords[] = "I want to enter AlceOSD setup";
@@ -250,6 +286,63 @@ void __attribute__((__interrupt__, auto_psv)) _U4RXInterrupt(void)
     IFS5bits.U4RXIF = 0;
 }
 
+/* send the contiguous part of the tx ring at tx_rd */
+static void uart_tx_start(unsigned char port)
+{
+    struct uart_fifo_s *f = &uart_fifo[port];
+    const struct uart_regs *r = &UARTS[port];
+    unsigned int rd = f->tx_rd, wr = f->tx_wr, len;
+
+    if (wr >= rd)
+        len = wr - rd;
+    else
+        len = f->tx_mask + 1 - rd;
+
+    f->tx_len = len;
+    if (len == 0)
+        return;
+
+    *(r->DMASTAL) = f->tx_dma + rd;
+    *(r->DMACNT) = len - 1;
+    *(r->DMACON) |= 0x8000;
+    /* when the uart fifo is full the next tx interrupt
+       requests the first byte */
+    if ((*(r->STA) & 0x0200) == 0)
+        *(r->DMAREQ) |= 0x8000;
+}
+
+inline static void handle_tx_dma_int(unsigned char port)
+{
+    struct uart_fifo_s *f = &uart_fifo[port];
+
+    f->tx_rd = (f->tx_rd + f->tx_len) & f->tx_mask;
+    uart_tx_start(port);
+}
+
+void __attribute__((__interrupt__, auto_psv)) _DMA0Interrupt(void)
+{
+    handle_tx_dma_int(0);
+    IFS0bits.DMA0IF = 0;
+}
+
+void __attribute__((__interrupt__, auto_psv)) _DMA1Interrupt(void)
+{
+    handle_tx_dma_int(1);
+    IFS0bits.DMA1IF = 0;
+}
+
+void __attribute__((__interrupt__, auto_psv)) _DMA2Interrupt(void)
+{
+    handle_tx_dma_int(2);
+    IFS1bits.DMA2IF = 0;
+}
+
+void __attribute__((__interrupt__, auto_psv)) _DMA3Interrupt(void)
+{
+    handle_tx_dma_int(3);
+    IFS2bits.DMA3IF = 0;
+}
+
 void uart_set_direction(unsigned char port, unsigned char direction)
 {
     unsigned char t;
@@ -279,7 +372,8 @@ void uart_set_direction(unsigned char port, unsigned char direction)
         /* enable tx */
         *(UARTS[port].STA) |= 0x0400;
     } else {
-        /* disable tx */
+        /* disable tx once the ring is sent */
+        while (uart_fifo[port].tx_len != 0);
         while ( (*(UARTS[port].STA) & 0x0100) == 0);
         *(UARTS[port].STA) &= ~0x0400;
         
@@ -328,6 +422,11 @@ static void uart_init_(unsigned char port)
             DMA0STAL = __builtin_dmaoffset(&tx_buf1);
             DMA0STAH = __builtin_dmapage(&tx_buf1);
             uart_fifo[0].tx_buf = tx_buf1;
+            uart_fifo[0].tx_mask = UART_TX_BUF_SIZE - 1;
+            uart_fifo[0].tx_dma = __builtin_dmaoffset(&tx_buf1);
+            _DMA0IP = 1;
+            _DMA0IF = 0;
+            _DMA0IE = 1;
             break;
         case UART_PORT2:
             _U2RXIP = 1;
@@ -339,6 +438,11 @@ static void uart_init_(unsigned char port)
             DMA1STAL = __builtin_dmaoffset(&tx_buf2);
             DMA1STAH = __builtin_dmapage(&tx_buf2);
             uart_fifo[1].tx_buf = tx_buf2;
+            uart_fifo[1].tx_mask = UART_TX_BUF_SIZE - 1;
+            uart_fifo[1].tx_dma = __builtin_dmaoffset(&tx_buf2);
+            _DMA1IP = 1;
+            _DMA1IF = 0;
+            _DMA1IE = 1;
             break;
         case UART_PORT3:
             _U3RXIP = 1;
@@ -350,6 +454,11 @@ static void uart_init_(unsigned char port)
             DMA2STAL = __builtin_dmaoffset(&tx_buf3);
             DMA2STAH = __builtin_dmapage(&tx_buf3);
             uart_fifo[2].tx_buf = tx_buf3;
+            uart_fifo[2].tx_mask = UART_TX_BUF_SIZE_SMALL - 1;
+            uart_fifo[2].tx_dma = __builtin_dmaoffset(&tx_buf3);
+            _DMA2IP = 1;
+            _DMA2IF = 0;
+            _DMA2IE = 1;
             break;
         case UART_PORT4:
             _U4RXIP = 1;
@@ -361,6 +470,11 @@ static void uart_init_(unsigned char port)
             DMA3STAL = __builtin_dmaoffset(&tx_buf4);
             DMA3STAH = __builtin_dmapage(&tx_buf4);
             uart_fifo[3].tx_buf = tx_buf4;
+            uart_fifo[3].tx_mask = UART_TX_BUF_SIZE_SMALL - 1;
+            uart_fifo[3].tx_dma = __builtin_dmaoffset(&tx_buf4);
+            _DMA3IP = 1;
+            _DMA3IF = 0;
+            _DMA3IE = 1;
             break;
         default:
             break;
@@ -423,106 +537,115 @@ static inline unsigned int uart4_read(unsigned char *buf, unsigned int len)
     return uart_read(3, buf, len);
 }
 
+/* readable bytes from rd up to the end of the ring or wr, the rest
+   (if wrapped) is the next segment once these are released */
+static unsigned int uart_peek(u8 port, u8 **buf)
+{
+    u16 rd = uart_fifo[port].rd;
+    u16 wr = uart_fifo[port].wr;
+
+    uart_fifo[port].peek_rd = rd;
+    *buf = &uart_fifo[port].buf[rd];
+    if (wr >= rd)
+        return wr - rd;
+    else
+        return UART_FIFO_MASK + 1 - rd;
+}
+
+static unsigned int uart1_peek(unsigned char **buf) { return uart_peek(0, buf); }
+static unsigned int uart2_peek(unsigned char **buf) { return uart_peek(1, buf); }
+static unsigned int uart3_peek(unsigned char **buf) { return uart_peek(2, buf); }
+static unsigned int uart4_peek(unsigned char **buf) { return uart_peek(3, buf); }
+
+/* the rx interrupt flushes the ring when the shell takes the port,
+   bytes peeked before that are gone and must not be released */
+static unsigned int uart_release(u8 port, u16 len)
+{
+    int ipl;
+
+    SET_AND_SAVE_CPU_IPL(ipl, 1);
+    if (uart_fifo[port].rd == uart_fifo[port].peek_rd)
+        uart_discard(port, len);
+    else
+        len = 0;
+    RESTORE_CPU_IPL(ipl);
+    return len;
+}
+
+static unsigned int uart1_release(unsigned int len) { return uart_release(0, len); }
+static unsigned int uart2_release(unsigned int len) { return uart_release(1, len); }
+static unsigned int uart3_release(unsigned int len) { return uart_release(2, len); }
+static unsigned int uart4_release(unsigned int len) { return uart_release(3, len); }
+
 static inline unsigned int uart1_avail() { return uart_count(0); }
 static inline unsigned int uart2_avail() { return uart_count(1); }
 static inline unsigned int uart3_avail() { return uart_count(2); }
 static inline unsigned int uart4_avail() { return uart_count(3); }
 
-static int uart1_write(unsigned char *buf, unsigned int len)
+static unsigned int uart_tx_room(u8 port)
 {
-    __eds__ unsigned char *b = tx_buf1;
-    
-    if (len == 0)
-        return 0;
-    
-    if (U1STAbits.TRMT == 0) {
-        uart_fifo[0].full++;
-        return 1;
-        //while (U1STAbits.TRMT == 0);
-    }
+    struct uart_fifo_s *f = &uart_fifo[port];
+    unsigned int room = f->tx_mask - ((f->tx_wr - f->tx_rd) & f->tx_mask);
 
-    len = min(len, UART_TX_BUF_SIZE);
-    uart_fifo[0].tx += (u32) len;
-    DMA0CNT = len - 1;
-    while (len-- > 0)
-        *b++ = *buf++;
-
-    DMA0CONbits.CHEN = 1;
-    DMA0REQbits.FORCE = 1;
-    return 0;
+    return (room > UART_TX_PRIO_ROOM) ? (room - UART_TX_PRIO_ROOM) : 0;
 }
 
-static int uart2_write(unsigned char *buf, unsigned int len)
+static unsigned int uart1_tx_room(void) { return uart_tx_room(0); }
+static unsigned int uart2_tx_room(void) { return uart_tx_room(1); }
+static unsigned int uart3_tx_room(void) { return uart_tx_room(2); }
+static unsigned int uart4_tx_room(void) { return uart_tx_room(3); }
+
+/* queue a whole packet or drop it, normal writes leave
+   UART_TX_PRIO_ROOM bytes free for priority ones */
+static int uart_write(u8 port, unsigned char *buf, unsigned int len, u8 prio)
 {
-    __eds__ unsigned char *b = tx_buf2;
-    
+    struct uart_fifo_s *f = &uart_fifo[port];
+    const struct uart_regs *r = &UARTS[port];
+    __eds__ unsigned char *b;
+    unsigned int wr = f->tx_wr, used, room, n, i;
+
     if (len == 0)
         return 0;
-    
-    if (U2STAbits.TRMT == 0) {
-        uart_fifo[1].full++;
+
+    used = (wr - f->tx_rd) & f->tx_mask;
+    room = f->tx_mask - used;
+    if (!prio)
+        room = (room > UART_TX_PRIO_ROOM) ? (room - UART_TX_PRIO_ROOM) : 0;
+    if (len > room) {
+        f->full++;
         return 1;
-        //while (U2STAbits.TRMT == 0);
     }
 
-    len = min(len, UART_TX_BUF_SIZE);
-    uart_fifo[1].tx += (u32) len;
-    DMA1CNT = len - 1;
-    while (len-- > 0)
+    /* copy, wrapping at the end of the ring */
+    n = min(len, f->tx_mask + 1 - wr);
+    b = &f->tx_buf[wr];
+    for (i = 0; i < len; i++) {
+        if (i == n)
+            b = f->tx_buf;
         *b++ = *buf++;
-
-    DMA1CONbits.CHEN = 1;
-    DMA1REQbits.FORCE = 1;
-    return 0;
-}
-
-static int uart3_write(unsigned char *buf, unsigned int len)
-{
-    __eds__ unsigned char *b = tx_buf3;
-    
-    if (len == 0)
-        return 0;
-    
-    if (U3STAbits.TRMT == 0) {
-        uart_fifo[2].full++;
-        return 1;
-        //while (U3STAbits.TRMT == 0);
     }
+    f->tx += (u32) len;
 
-    len = min(len, UART_TX_BUF_SIZE);
-    uart_fifo[2].tx += (u32) len;
-    DMA2CNT = len - 1;
-    while (len-- > 0)
-        *b++ = *buf++;
+    /* keep the dma interrupt out while checking if it is idle */
+    *(r->DMAIEC) &= ~r->DMAIE;
+    f->tx_wr = (wr + len) & f->tx_mask;
+    if (f->tx_len == 0)
+        uart_tx_start(port);
+    *(r->DMAIEC) |= r->DMAIE;
 
-    DMA2CONbits.CHEN = 1;
-    DMA2REQbits.FORCE = 1;
+    f->tx_max = max(f->tx_max, used);
     return 0;
 }
 
-static int uart4_write(unsigned char *buf, unsigned int len)
-{
-    __eds__ unsigned char *b = tx_buf4;
-    
-    if (len == 0)
-        return 0;
-    
-    if (U4STAbits.TRMT == 0) {
-        uart_fifo[3].full++;
-        return 1;
-        //while (U4STAbits.TRMT == 0);
-    }
-
-    len = min(len, UART_TX_BUF_SIZE);
-    uart_fifo[3].tx += (u32) len;
-    DMA3CNT = len - 1;
-    while (len-- > 0)
-        *b++ = *buf++;
+static int uart1_write(unsigned char *buf, unsigned int len) { return uart_write(0, buf, len, 0); }
+static int uart2_write(unsigned char *buf, unsigned int len) { return uart_write(1, buf, len, 0); }
+static int uart3_write(unsigned char *buf, unsigned int len) { return uart_write(2, buf, len, 0); }
+static int uart4_write(unsigned char *buf, unsigned int len) { return uart_write(3, buf, len, 0); }
 
-    DMA3CONbits.CHEN = 1;
-    DMA3REQbits.FORCE = 1;
-    return 0;
-}
+static int uart1_write_prio(unsigned char *buf, unsigned int len) { return uart_write(0, buf, len, 1); }
+static int uart2_write_prio(unsigned char *buf, unsigned int len) { return uart_write(1, buf, len, 1); }
+static int uart3_write_prio(unsigned char *buf, unsigned int len) { return uart_write(2, buf, len, 1); }
+static int uart4_write_prio(unsigned char *buf, unsigned int len) { return uart_write(3, buf, len, 1); }
 
 unsigned char uart_getc(unsigned char port, char *c)
 {
@@ -653,23 +776,39 @@ void uart_set_client(unsigned char port, unsigned char client_id,
             switch (port) {
                 case UART_PORT1:
                     (*c)->write = uart1_write;
+                    (*c)->write_prio = uart1_write_prio;
+                    (*c)->tx_room = uart1_tx_room;
                     (*c)->read = uart1_read;
                     (*c)->avail = uart1_avail;
+                    (*c)->peek = uart1_peek;
+                    (*c)->release = uart1_release;
                     break;
                 case UART_PORT2:
                     (*c)->write = uart2_write;
+                    (*c)->write_prio = uart2_write_prio;
+                    (*c)->tx_room = uart2_tx_room;
                     (*c)->read = uart2_read;
                     (*c)->avail = uart2_avail;
+                    (*c)->peek = uart2_peek;
+                    (*c)->release = uart2_release;
                     break;
                 case UART_PORT3:
                     (*c)->write = uart3_write;
+                    (*c)->write_prio = uart3_write_prio;
+                    (*c)->tx_room = uart3_tx_room;
                     (*c)->read = uart3_read;
                     (*c)->avail = uart3_avail;
+                    (*c)->peek = uart3_peek;
+                    (*c)->release = uart3_release;
                     break;
                 case UART_PORT4:
                     (*c)->write = uart4_write;
+                    (*c)->write_prio = uart4_write_prio;
+                    (*c)->tx_room = uart4_tx_room;
                     (*c)->read = uart4_read;
                     (*c)->avail = uart4_avail;
+                    (*c)->peek = uart4_peek;
+                    (*c)->release = uart4_release;
                     break;
                 default:
                     break;
@@ -790,13 +929,14 @@ static void shell_cmd_stats(char *args, void *data)
     shell_printf("\nStats:\n");
     for (i = 0; i < 4; i++) {
         shell_printf(" port%d: tx=%lu rx=%lu", i, uart_fifo[i].tx, uart_fifo[i].rx);
-        shell_printf(" orun=%u oflow=%u txfull=%u (rxloop=%u max=%u)\n",
+        shell_printf(" orun=%u oflow=%u txdrop=%u (rxloop=%u max=%u txmax=%u)\n",
                 uart_fifo[i].overrun, uart_fifo[i].overflow, uart_fifo[i].full,
-                uart_fifo[i].m, uart_fifo[i].max);
+                uart_fifo[i].m, uart_fifo[i].max, uart_fifo[i].tx_max);
         uart_fifo[i].m = 0;
         uart_fifo[i].max = 0;
         uart_fifo[i].overflow = 0;
         uart_fifo[i].full = 0;
+        uart_fifo[i].tx_max = 0;
     }
 }
 
@@ -63,7 +63,15 @@ enum {
 #define UART_PROP_RX_INVERTED       2
 #define UART_PROP_HALF_DUPLEX       4
 
-#define UART_TX_BUF_SIZE    (128)
+/* tx rings, must be powers of 2. SERIAL1/2 take full size mavlink
+   packets, SERIAL3/4 (newer boards only) get the small ones */
+#define UART_TX_BUF_SIZE        (512)
+#define UART_TX_BUF_SIZE_SMALL  (256)
+#define UART_TX_RAM_SIZE        ((UART_TX_BUF_SIZE + UART_TX_BUF_SIZE_SMALL) * 2)
+/* ring space only priority writes can use */
+#define UART_TX_PRIO_ROOM       (64)
+/* largest write that always fits an empty ring of any port */
+#define UART_TX_MAX_WRITE       (UART_TX_BUF_SIZE_SMALL - UART_TX_PRIO_ROOM - 1)
 
 struct baudrate_tbl {
     unsigned long baudrate;
@@ -95,8 +103,17 @@ struct uart_client {
 
     /* modules should use these functions to send and receive data */
     int (*write)(unsigned char *buf, unsigned int len);
+    int (*write_prio)(unsigned char *buf, unsigned int len);
+    /* bytes a normal write can queue right now */
+    unsigned int (*tx_room)(void);
     unsigned int (*read)(unsigned char *buf, unsigned int len);
     unsigned int (*avail)();
+
+    /* in place access to the rx ring: peek returns the contiguous
+       segment at the read position, release frees parsed bytes
+       (0 if the ring was flushed since the peek) */
+    unsigned int (*peek)(unsigned char **buf);
+    unsigned int (*release)(unsigned int len);
 };
 
 void uart_init(void);
@@ -139,11 +139,16 @@ static struct canvas_pipe_s {
     .prd = 0,
 };
 
+/* areas waiting to be erased through the canvas pipe */
+#define MAX_ERASE_CANVAS (8)
+static struct canvas erase_canvas_pool[MAX_ERASE_CANVAS];
+static unsigned int erase_fallback = 0;
+
 
 #define SCRATCHPAD1_SIZE 0x5000
-#define SCRATCHPAD2_SIZE 0x2000
+#define SCRATCHPAD2_SIZE (0x8000 - SCRATCHPAD2_ADDR)
 __eds__ unsigned char scratchpad1[SCRATCHPAD1_SIZE]  __attribute__ ((eds, noload, address(0x8000)));
-__eds__ unsigned char scratchpad2[SCRATCHPAD2_SIZE]  __attribute__ ((eds, noload, address(0x6000)));
+__eds__ unsigned char scratchpad2[SCRATCHPAD2_SIZE]  __attribute__ ((eds, noload, address(SCRATCHPAD2_ADDR)));
 
 struct scratchpad_s {
     __eds__ unsigned char *mem;
@@ -783,6 +788,11 @@ void video_set_input(void)
     }
 }
 
+unsigned char video_get_profile(void)
+{
+    return (unsigned char) (cfg - config.video_profile);
+}
+
 void video_get_size(unsigned int *xsize, unsigned int *ysize)
 {
     *xsize = video_xsizes[cfg->x_size_id].xsize;
@@ -795,17 +805,28 @@ void video_get_size(unsigned int *xsize, unsigned int *ysize)
 
 void free_mem(void)
 {
+    unsigned char i;
+
     scratchpad[0].alloc_size = 0;
     scratchpad[1].alloc_size = 0;
 
     canvas_pipe.prd = canvas_pipe.pwr = 0;
     rendering_canvas = NULL;
+
+    for (i = 0; i < MAX_ERASE_CANVAS; i++)
+        erase_canvas_pool[i].lock = 0;
 }
 
 static void set_canvas_pos(struct canvas *c, struct widget_config *wcfg)
 {
     u16 osdxsize, osdysize;
+    u16 width = c->width, height = c->height;
     video_get_size(&osdxsize, &osdysize);
+
+    if (c->rows > 0) {
+        width = c->area_width;
+        height = c->height * c->rows;
+    }
     
     switch (wcfg->props.vjust) {
         case VJUST_TOP:
@@ -813,10 +834,10 @@ static void set_canvas_pos(struct canvas *c, struct widget_config *wcfg)
             c->y = wcfg->y;
             break;
         case VJUST_BOT:
-            c->y = osdysize - c->height + wcfg->y;
+            c->y = osdysize - height + wcfg->y;
             break;
         case VJUST_CENTER:
-            c->y = (osdysize - c->height)/2 + wcfg->y;
+            c->y = (osdysize - height)/2 + wcfg->y;
             break;
     }
     switch (wcfg->props.hjust) {
@@ -825,12 +846,14 @@ static void set_canvas_pos(struct canvas *c, struct widget_config *wcfg)
             c->x = wcfg->x;
             break;
         case HJUST_RIGHT:
-            c->x = osdxsize - c->width + wcfg->x;
+            c->x = osdxsize - width + wcfg->x;
             break;
         case HJUST_CENTER:
-            c->x = (osdxsize - c->width)/2 + wcfg->x;
+            c->x = (osdxsize - width)/2 + wcfg->x;
             break;
     }
+    c->area_x = c->x;
+    c->area_y = c->y;
 }
 
 int alloc_canvas(struct canvas *c, void *widget_cfg)
@@ -841,6 +864,8 @@ int alloc_canvas(struct canvas *c, void *widget_cfg)
     c->width = (c->width & 0xfffc);
     c->rwidth = c->width >> 2;
     c->size = c->rwidth * c->height;
+    c->area_width = c->width;
+    c->fresh = 1;
 
     if (c->size == 0) {
         c->lock = 1;
@@ -853,6 +878,7 @@ int alloc_canvas(struct canvas *c, void *widget_cfg)
     }
     if (i == 2) {
         c->lock = 1;
+        c->size = 0;
         return -1;
     }
     c->buf = &scratchpad[i].mem[scratchpad[i].alloc_size];
@@ -884,19 +910,76 @@ int init_canvas(struct canvas *ca)
 {
     if (ca->lock)
         return -1;
-    clear_canvas(ca->buf, ca->size, 0);
+    if (!ca->keep || ca->fresh)
+        clear_canvas(ca->buf, ca->size, 0);
     return 0;
 }
 
 
+/* copy a window of a pre-rendered canvas starting at column x, row y
+ * to row dy of the destination. x does not need to be byte aligned. */
+void copy_canvas(struct canvas *dst, u16 dy, struct canvas *src, u16 x, u16 y)
+{
+    __eds__ unsigned char *d = dst->buf + dy * dst->rwidth;
+    __eds__ unsigned char *b = src->buf + (u32) y * src->rwidth + (x >> 2);
+    unsigned char sh = (x & 3) << 1;
+    u16 h, i;
+
+    h = min(dst->height - dy, src->height - y);
+    for (; h > 0; h--) {
+        if (sh == 0) {
+            for (i = 0; i < dst->rwidth; i++)
+                d[i] = b[i];
+        } else {
+            for (i = 0; i < dst->rwidth; i++)
+                d[i] = (b[i] << sh) | (b[i+1] >> (8 - sh));
+        }
+        d += dst->rwidth;
+        b += src->rwidth;
+    }
+}
+
 void schedule_canvas(struct canvas *ca)
 {
     canvas_pipe.ca[canvas_pipe.pwr++] = ca;
     canvas_pipe.pwr &= MAX_CANVAS_PIPE_MASK;
     canvas_pipe.peak = max(canvas_pipe.peak, canvas_pipe.pwr - canvas_pipe.prd);
     ca->lock = 1;
+    ca->sched_time = get_micros();
 }
 
+unsigned char canvas_pipe_count(void)
+{
+    return (canvas_pipe.pwr - canvas_pipe.prd) & MAX_CANVAS_PIPE_MASK;
+}
+
+
+/* upload a line of a scrolling strip, rotated to start at column scroll */
+static __eds__ unsigned char* copy_line_strip(__eds__ unsigned char *b, struct canvas *ca)
+{
+    unsigned int r = ca->scroll >> 2, len = ca->strip_len >> 2, i;
+    unsigned char s = (ca->scroll & 3) << 1;
+    unsigned char v, n;
+
+    if (s == 0) {
+        copy_line(b + r, len - r);
+        if (r > 0)
+            copy_line(b, r);
+    } else {
+        /* not byte aligned: merge pixels of adjacent bytes */
+        v = b[r];
+        for (i = 0; i < len; i++) {
+            if (++r == len)
+                r = 0;
+            n = b[r];
+            sram_byteo_sqi((v << s) | (n >> (8 - s)));
+            v = n;
+        }
+    }
+    if (ca->rwidth > len)
+        copy_line(b + len, ca->rwidth - len);
+    return b + ca->rwidth;
+}
 
 static void render_process(void)
 {
@@ -948,7 +1031,14 @@ static void render_process(void)
                 sram_byteo_sqi(addr.b2);
                 sram_byteo_sqi(addr.b1);
                 sram_byteo_sqi(addr.b0);
-                b = copy_line(b, rendering_canvas->rwidth);
+                if (rendering_canvas->erase) {
+                    for (x = rendering_canvas->rwidth; x > 0; x--)
+                        sram_byteo_sqi(0);
+                } else if (rendering_canvas->strip_len > 0) {
+                    b = copy_line_strip(b, rendering_canvas);
+                } else {
+                    b = copy_line(b, rendering_canvas->rwidth);
+                }
                 CS_HIGH;
 
                 if (++y == y1)
@@ -957,6 +1047,7 @@ static void render_process(void)
                 addr.l += xsize;
             }
             rendering_canvas->lock = 0;
+            rendering_canvas->pipe_wait = (u16) min(get_micros() - rendering_canvas->sched_time, 0xffff);
             canvas_pipe.prd++;
             canvas_pipe.prd &= MAX_CANVAS_PIPE_MASK;
             rendering_canvas = NULL;
@@ -997,12 +1088,81 @@ static void render_canvas(struct canvas *ca)
     }
 }
 
+/* restore the row canvas to the whole row width */
+static void canvas_row(struct canvas *ca, unsigned char row)
+{
+    ca->x = ca->area_x;
+    ca->y = ca->area_y + row * ca->height;
+    ca->width = ca->area_width;
+    ca->rwidth = ca->width >> 2;
+}
+
+/* blocking erase of the canvas area */
+void erase_canvas(struct canvas *ca)
+{
+    unsigned char i;
+
+    if (ca->size == 0)
+        return;
+    clear_canvas(ca->buf, ca->size, 0);
+    if (ca->rows == 0) {
+        render_canvas(ca);
+        return;
+    }
+    for (i = 0; i < ca->rows; i++) {
+        canvas_row(ca, i);
+        render_canvas(ca);
+    }
+    canvas_row(ca, 0);
+}
+
+/* queue an erase of the canvas area through the pipe */
+static void erase_canvas_async(struct canvas *ca)
+{
+    struct canvas *e = erase_canvas_pool;
+    unsigned char i;
+
+    if (ca->size == 0)
+        return;
+
+    for (i = 0; i < MAX_ERASE_CANVAS; i++, e++) {
+        if (e->lock == 0)
+            break;
+    }
+    if ((i == MAX_ERASE_CANVAS) || (canvas_pipe_count() == MAX_CANVAS_PIPE_MASK)) {
+        /* no room, do it the slow way */
+        erase_fallback++;
+        erase_canvas(ca);
+        return;
+    }
+
+    if (ca->rows > 0) {
+        e->x = ca->area_x;
+        e->y = ca->area_y;
+        e->width = ca->area_width;
+        e->height = ca->height * ca->rows;
+    } else {
+        e->x = ca->x;
+        e->y = ca->y;
+        e->width = ca->width;
+        e->height = ca->height;
+    }
+    e->rwidth = e->width >> 2;
+    e->size = ca->size;
+    e->erase = 1;
+    schedule_canvas(e);
+}
+
+/* move the canvas to the widget config position,
+ * the old area is erased asynchronously */
 void reconfig_canvas(struct canvas *ca, void *widget_cfg)
 {
     struct widget_config *cfg = (struct widget_config*) widget_cfg;
-    clear_canvas(ca->buf, ca->size, 0);
-    render_canvas(ca);
+    erase_canvas_async(ca);
+    if (ca->rows > 0)
+        canvas_row(ca, 0);
     set_canvas_pos(ca, cfg);
+    ca->fresh = 1;
 }
 
 
@@ -1936,8 +2096,9 @@ static void shell_cmd_stats(char *args, void *data)
     shell_printf(" scratchpad memory: A=%u/%u B=%u/%u\n",
                 scratchpad[0].alloc_size, scratchpad[0].alloc_max,
                 scratchpad[1].alloc_size, scratchpad[1].alloc_max);
-    shell_printf(" canvas fifo: size=%u peak=%u max=%u\n",
-                (canvas_pipe.pwr - canvas_pipe.prd) & MAX_CANVAS_PIPE_MASK, canvas_pipe.peak, MAX_CANVAS_PIPE_MASK+1);
+    shell_printf(" canvas fifo: size=%u peak=%u max=%u erase_fallback=%u\n",
+                (canvas_pipe.pwr - canvas_pipe.prd) & MAX_CANVAS_PIPE_MASK, canvas_pipe.peak, MAX_CANVAS_PIPE_MASK+1,
+                erase_fallback);
     shell_printf(" status: last_line_cnt=%u sram_busy=%u int_sync_cnt=%u\n",
                 last_line_cnt, sram_busy, atomic_get16(&int_sync_cnt));
     shell_printf(" nbusy_time=%lu render_time=%lu wait_time=%lu R%=%.2f W%=%.2f\n",
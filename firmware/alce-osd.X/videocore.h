@@ -52,6 +52,13 @@ enum {
 #define VIDEO_SCAN_PROGRESSIVE 0
 #define VIDEO_SCAN_INTERLACED  1
 
+/* ram above the linker sections:
+     0x8000-0xcfff  scratchpad A (20KB)
+     0x5a00-0x7fff  scratchpad B (9.5KB)
+     0x5400-0x59ff  uart tx dma rings (UART_TX_RAM_SIZE)
+   .data, .bss and the stack stay below 0x5400 */
+#define SCRATCHPAD2_ADDR    0x5a00
+
 #define VIDEO_ACTIVE_CONFIG         0xff
 
 union sram_addr {
@@ -83,6 +90,26 @@ struct canvas {
     unsigned char lock;
     
     u8 buf_nr;
+
+    /* profiling: time queued and time spent in the upload pipe (us) */
+    u32 sched_time;
+    u16 pipe_wait;
+
+    /* upload zeros instead of the buffer */
+    u8 erase;
+
+    /* text row canvas: the buffer holds one row of a rows tall area,
+     * x/y/width are set to the span being uploaded */
+    u8 rows;
+    u16 area_x, area_y, area_width;
+    /* set when the screen contents under the canvas are gone */
+    u8 fresh;
+
+    /* buffer is kept between renders, only cleared when fresh */
+    u8 keep;
+    /* scrolling strip: the first strip_len columns are a ring
+     * uploaded starting at column scroll */
+    u16 strip_len, scroll;
 };
 
 typedef union {
@@ -131,8 +158,11 @@ void init_video(void);
 int alloc_canvas(struct canvas *ca, void *widget_cfg);
 void free_canvas(struct canvas *c);
 void reconfig_canvas(struct canvas *ca, void *widget_cfg);
+void erase_canvas(struct canvas *ca);
 int init_canvas(struct canvas *ca);
 void schedule_canvas(struct canvas *ca);
+void copy_canvas(struct canvas *dst, u16 dy, struct canvas *src, u16 x, u16 y);
+unsigned char canvas_pipe_count(void);
 void free_mem(void);
 
 /* clear up display */
@@ -141,6 +171,7 @@ void clear_sram(void);
 
 void video_apply_config(unsigned char profile);
 void video_get_size(unsigned int *xsize, unsigned int *ysize);
+unsigned char video_get_profile(void);
 
 
 void video_pause(void);
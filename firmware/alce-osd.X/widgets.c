@@ -72,46 +72,326 @@ const struct widget_ops *all_widget_ops[] = {
     NULL,
 };
 
-#define WIDGET_FIFO_MASK        (0x1f)
-#define MAX_WIDGET_ALLOC_MEM    (0x400)
+#define MAX_WIDGET_ALLOC_MEM    (0x600)
 #define MAX_ACTIVE_WIDGETS      (CONFIG_MAX_WIDGETS)
 
+/* widget memory pool
+ * blocks are carved from the pool on demand and recycled on per size
+ * class free lists. adjacent free blocks are merged and the free tail
+ * is given back when the pool runs out or widgets are reloaded.
+ * every block is tagged with the owner widget (id+uid) so it can be
+ * released when the widget closes.
+ * state blocks are parked instead of released on close and handed
+ * back to the same widget if it gets loaded again. */
+#define WIDGET_MEM_CLASSES      (8)
+#define WIDGET_MEM_LARGE        (WIDGET_MEM_CLASSES)
+
+#define WIDGET_MEM_USED         (0x01)
+#define WIDGET_MEM_STATE        (0x02)
+#define WIDGET_MEM_PARKED       (0x04)
+
+#define WIDGET_OWNER(cfg)       (((cfg)->widget_id << 8) | (cfg)->uid)
+/* owners no widget uses, for renaming kept widgets on a tab switch */
+#define WIDGET_OWNER_TMP(n)     (0xff00 | (n))
+
+static const unsigned int widget_mem_class_size[WIDGET_MEM_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256,
+};
+
+struct widget_mem_hdr {
+    unsigned int owner;
+    unsigned int size;
+    unsigned char cls;
+    unsigned char flags;
+    struct widget_mem_hdr *next;
+};
+
 struct widgets_mem_s {
     unsigned char mem[MAX_WIDGET_ALLOC_MEM];
     unsigned int alloc_size;
+    struct widget_mem_hdr *free[WIDGET_MEM_CLASSES + 1];
+    unsigned int used, peak, fails;
 } widgets_mem __attribute__((aligned(2))) = {
     .alloc_size = 0,
 };
 
-struct widget_fifo {
-    unsigned char rd;
-    unsigned char wr;
-    unsigned char peak;
-    struct widget *fifo[WIDGET_FIFO_MASK + 1];
-} wfifo = {
-    .rd = 0,
-    .wr = 0,
-};
+static unsigned int alloc_owner = 0;
+
+/* ready set scheduler
+ * widgets waiting to be rendered are flagged on a per priority bitmap
+ * indexed by the widget slot */
+#define WIDGET_READY_WORDS      ((MAX_ACTIVE_WIDGETS + 15) / 16)
+#define WIDGET_READY_PRIOS      (WIDGET_PRIO_HIGH)
+#define WIDGETS_RENDER_BUDGET   (2000)
+#define WIDGETS_MAX_PIPE        (24)
+#define WIDGET_STARVE_TIME      (500000)
+
+static struct widget_ready {
+    u16 set[WIDGET_READY_PRIOS][WIDGET_READY_WORDS];
+    unsigned char cursor[WIDGET_READY_PRIOS];
+    unsigned char count, peak;
+    /* render requests merged into a pending one */
+    unsigned long merged;
+    /* renders promoted after waiting too long */
+    unsigned long starved;
+} wready;
+
+static struct widget *slot_widgets[MAX_ACTIVE_WIDGETS];
 
 extern struct alceosd_config config;
 static struct widget *active_widgets[MAX_ACTIVE_WIDGETS];
 static unsigned char total_active_widgets = 0;
 static struct widget *selected_widget = NULL;
 
-/* custom memory allocator for widgets */
-void* widget_malloc(unsigned int size)
+/* per-widget render profiling */
+static struct widget_stats widget_stats[MAX_ACTIVE_WIDGETS];
+static unsigned long stats_start = 0;
+static struct timer *stats_tmr = NULL;
+static unsigned char stats_idx = 0;
+
+/* refresh governor */
+#define GOV_PERIOD              (100)
+#define GOV_STEP                (100)
+#define GOV_MAX_LEVEL           (4)
+#define GOV_DEFAULT_MIN_RATE    (2)
+#define GOV_CPU_HIGH            (40)
+#define GOV_CPU_LOW             (20)
+#define GOV_UPLOAD_HIGH         (80)
+#define GOV_UPLOAD_LOW          (50)
+#define GOV_QUEUE_HIGH          (8)
+#define GOV_QUEUE_LOW           (2)
+#define GOV_RELAX_WINDOWS       (5)
+
+extern unsigned long nbusy_time, render_time;
+
+static struct widget_governor {
+    unsigned char level;
+    unsigned char relax;
+    /* load (%) measured during the last window */
+    unsigned char cpu, upload, queue;
+    unsigned long render_time;
+    unsigned long last_nbusy, last_upload;
+    unsigned long deferred;
+} gov = {
+    .level = 0,
+};
+
+/* give the unused tail of the pool back and merge adjacent free blocks */
+static void widget_mem_compact(void)
 {
-    unsigned char *ptr;
+    struct widget_mem_hdr *h, *run = NULL;
+    unsigned int i = 0, top = 0, end;
+    unsigned char cls;
+
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        i += sizeof(struct widget_mem_hdr) + h->size;
+        if (h->flags != 0)
+            top = i;
+    }
+    widgets_mem.alloc_size = top;
+    memset(widgets_mem.free, 0, sizeof(widgets_mem.free));
+
+    i = 0;
+    while (i <= top) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        if ((i < top) && (h->flags == 0)) {
+            if (run == NULL)
+                run = h;
+            i += sizeof(struct widget_mem_hdr) + h->size;
+            continue;
+        }
+        if (run != NULL) {
+            /* one free block for the whole run */
+            end = i;
+            run->size = end - ((unsigned char*) run - widgets_mem.mem) -
+                            sizeof(struct widget_mem_hdr);
+            if (run->size > widget_mem_class_size[WIDGET_MEM_CLASSES - 1]) {
+                cls = WIDGET_MEM_LARGE;
+            } else {
+                for (cls = WIDGET_MEM_CLASSES; cls-- > 1; ) {
+                    if (widget_mem_class_size[cls] <= run->size)
+                        break;
+                }
+            }
+            run->cls = cls;
+            run->next = widgets_mem.free[cls];
+            widgets_mem.free[cls] = run;
+            run = NULL;
+        }
+        if (i == top)
+            break;
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+}
+
+static struct widget_mem_hdr* widget_mem_find(unsigned int size, unsigned char cls)
+{
+    struct widget_mem_hdr *h, **prev;
+
+    /* recycle a free block, from a larger class if needed */
+    for (; cls <= WIDGET_MEM_LARGE; cls++) {
+        prev = &widgets_mem.free[cls];
+        for (h = *prev; h != NULL; h = h->next) {
+            if (h->size >= size) {
+                *prev = h->next;
+                return h;
+            }
+            prev = &h->next;
+        }
+    }
+    return NULL;
+}
+
+static struct widget_mem_hdr* widget_mem_get(unsigned int size)
+{
+    struct widget_mem_hdr *h;
+    unsigned char cls;
+
     size = (size + 1) & 0xfffe;
-    if ((widgets_mem.alloc_size + size) >= MAX_WIDGET_ALLOC_MEM)
+    for (cls = 0; cls < WIDGET_MEM_CLASSES; cls++) {
+        if (size <= widget_mem_class_size[cls])
+            break;
+    }
+
+    h = widget_mem_find(size, cls);
+    if (h != NULL)
+        return h;
+
+    /* carve a new one */
+    if (cls != WIDGET_MEM_LARGE)
+        size = widget_mem_class_size[cls];
+    if ((widgets_mem.alloc_size + sizeof(struct widget_mem_hdr) + size) > MAX_WIDGET_ALLOC_MEM) {
+        /* out of pool: merge the free blocks and try again */
+        widget_mem_compact();
+        h = widget_mem_find(size, cls);
+        if (h != NULL)
+            return h;
+        if ((widgets_mem.alloc_size + sizeof(struct widget_mem_hdr) + size) > MAX_WIDGET_ALLOC_MEM)
+            return NULL;
+    }
+
+    h = (struct widget_mem_hdr*) &widgets_mem.mem[widgets_mem.alloc_size];
+    widgets_mem.alloc_size += sizeof(struct widget_mem_hdr) + size;
+    h->size = size;
+    h->cls = cls;
+    return h;
+}
+
+static void* widget_mem_alloc(unsigned int size, unsigned char flags)
+{
+    struct widget_mem_hdr *h = widget_mem_get(size);
+
+    if (h == NULL) {
+        widgets_mem.fails++;
         return NULL;
+    }
+    h->owner = alloc_owner;
+    h->flags = WIDGET_MEM_USED | flags;
+    h->next = NULL;
+
+    widgets_mem.used += h->size;
+    widgets_mem.peak = max(widgets_mem.peak, widgets_mem.used);
+
+    memset(h + 1, 0, h->size);
+    return h + 1;
+}
+
+static void widget_mem_release(struct widget_mem_hdr *h)
+{
+    widgets_mem.used -= h->size;
+    h->flags = 0;
+    h->next = widgets_mem.free[h->cls];
+    widgets_mem.free[h->cls] = h;
+}
+
+/* custom memory allocator for widgets */
+void* widget_malloc(unsigned int size)
+{
+    return widget_mem_alloc(size, 0);
+}
 
-    ptr = &widgets_mem.mem[widgets_mem.alloc_size];
-    widgets_mem.alloc_size += size;
+/* widget state that survives closing the widget (ex: tab switch)
+ * restored is set when the previous state was handed back */
+void* widget_malloc_state(unsigned int size, unsigned char *restored)
+{
+    struct widget_mem_hdr *h;
+    unsigned int i = 0;
+
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        if ((h->flags & WIDGET_MEM_PARKED) && (h->owner == alloc_owner)) {
+            if (h->size >= size) {
+                h->flags &= ~WIDGET_MEM_PARKED;
+                *restored = 1;
+                return h + 1;
+            }
+            widget_mem_release(h);
+        }
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+
+    *restored = 0;
+    return widget_mem_alloc(size, WIDGET_MEM_STATE);
+}
+
+void widget_free(void *ptr)
+{
+    struct widget_mem_hdr *h;
+
+    if (ptr == NULL)
+        return;
+    h = (struct widget_mem_hdr*) ptr - 1;
+    if (h->flags & WIDGET_MEM_USED)
+        widget_mem_release(h);
+}
+
+/* release all memory owned by a widget, park state blocks if requested */
+static void widget_free_owner(unsigned int owner, unsigned char park)
+{
+    struct widget_mem_hdr *h;
+    unsigned int i = 0;
+
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        if ((h->flags & WIDGET_MEM_USED) && (h->owner == owner) &&
+                    ((h->flags & WIDGET_MEM_PARKED) == 0)) {
+            if (park && (h->flags & WIDGET_MEM_STATE))
+                h->flags |= WIDGET_MEM_PARKED;
+            else
+                widget_mem_release(h);
+        }
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+}
 
-    memset(ptr, 0, size);
+/* hand all memory of a widget to a new owner */
+static void widget_mem_set_owner(unsigned int owner, unsigned int new_owner)
+{
+    struct widget_mem_hdr *h;
+    unsigned int i = 0;
+
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        if ((h->flags & WIDGET_MEM_USED) && (h->owner == owner))
+            h->owner = new_owner;
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+}
 
-    return ptr;
+/* release parked state that was not claimed back */
+static void widget_mem_gc(void)
+{
+    struct widget_mem_hdr *h;
+    unsigned int i = 0;
+
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        if (h->flags & WIDGET_MEM_PARKED)
+            widget_mem_release(h);
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+    widget_mem_compact();
 }
 
 const struct widget_ops *get_widget_ops(unsigned int id)
@@ -127,6 +407,21 @@ const struct widget_ops *get_widget_ops(unsigned int id)
     return (*w);
 }
 
+static unsigned char get_widget_slot(void)
+{
+    unsigned char i, j;
+
+    for (i = 0; i < MAX_ACTIVE_WIDGETS - 1; i++) {
+        for (j = 0; j < total_active_widgets; j++) {
+            if (active_widgets[j]->slot == i)
+                break;
+        }
+        if (j == total_active_widgets)
+            break;
+    }
+    return i;
+}
+
 struct widget* load_widget_config(struct widget_config *w_cfg)
 {
     const struct widget_ops *w_ops;
@@ -136,16 +431,26 @@ struct widget* load_widget_config(struct widget_config *w_cfg)
     if (w_ops == NULL)
         return NULL;
 
+    alloc_owner = WIDGET_OWNER(w_cfg);
     w = (struct widget*) widget_malloc(sizeof(struct widget));
     if (w == NULL)
         return NULL;
     w->ops = w_ops;
     w->cfg = w_cfg;
     w->status = 0;
-    if (w_ops->open(w))
+    w->slot = get_widget_slot();
+    w->stats = &widget_stats[w->slot];
+    memset(w->stats, 0, sizeof(struct widget_stats));
+    w->stats->min_time = 0xffff;
+    w->interval = 0;
+    w->last_sched = 0;
+    if (w_ops->open(w)) {
+        widget_free_owner(alloc_owner, 0);
         return NULL;
+    }
 
     active_widgets[total_active_widgets++] = w;
+    slot_widgets[w->slot] = w;
     return w;
 }
 
@@ -161,6 +466,15 @@ void load_widgets(void)
         if (w->ops->render)
             schedule_widget(w);
     }
+
+    /* optional canvases only get the room left by all widgets,
+       widgets render without them */
+    for (i = 0; i < total_active_widgets; i++) {
+        w = active_widgets[i];
+        if ((w->aux != NULL) && (w->ca.size != 0))
+            alloc_canvas(w->aux, w->cfg);
+    }
+    widget_mem_gc();
 }
 
 static void close_widgets(void)
@@ -172,54 +486,405 @@ static void close_widgets(void)
         w = active_widgets[i];
         if (w->ops->close)
             w->ops->close(w);
+        widget_free_owner(WIDGET_OWNER(w->cfg), 1);
     }
     total_active_widgets = 0;
 }
 
-static inline void render_widget(struct widget *w)
+static void close_widget(struct widget *w)
+{
+    if (w->ops->close)
+        w->ops->close(w);
+    remove_timers_data(TIMER_WIDGET, w);
+    del_mavlink_callbacks_data(CALLBACK_WIDGET, w);
+    widget_free_owner(WIDGET_OWNER(w->cfg), 1);
+}
+
+/* same widget drawing the same thing, position may differ */
+static unsigned char widget_cfg_match(struct widget_config *a, struct widget_config *b)
+{
+    return (a->widget_id == b->widget_id) &&
+            ((a->props.raw & ~0xf) == (b->props.raw & ~0xf)) &&
+            (a->sched.raw == b->sched.raw) &&
+            (memcmp(a->params, b->params, sizeof(a->params)) == 0);
+}
+
+static unsigned char widget_cfg_moved(struct widget_config *a, struct widget_config *b)
+{
+    return (a->x != b->x) || (a->y != b->y) ||
+            ((a->props.raw & 0xf) != (b->props.raw & 0xf));
+}
+
+static struct widget* get_active_widget(struct widget_config *w_cfg)
 {
-    if (init_canvas(&w->ca) == 0) {
-        w->ops->render(w);
-        if (selected_widget == w)
-            draw_rect(0, 0, w->ca.width-1, w->ca.height-1, ((get_millis16()/500) & 1) ? 3 : 1, &w->ca);
-        schedule_canvas(&w->ca);
+    unsigned char i;
+
+    for (i = 0; i < total_active_widgets; i++) {
+        if (active_widgets[i]->cfg == w_cfg)
+            return active_widgets[i];
     }
-    w->status = 0;
+    return NULL;
+}
+
+/* switch to a new tab keeping the widgets that exist on both tabs
+ * alive: only widgets that differ are closed/opened, moved widgets
+ * are relocated. video must be paused. */
+void widgets_switch_tab(struct widget_config *w_cfg, unsigned char tab)
+{
+    struct widget_config *c;
+    struct widget *w;
+    unsigned char i, n = 0;
+
+    memset(&wready.set, 0, sizeof(wready.set));
+    wready.count = 0;
+    selected_widget = NULL;
+
+    for (i = 0; i < total_active_widgets; i++) {
+        w = active_widgets[i];
+        w->status = 0;
+
+        /* look for an unclaimed twin on the new tab,
+           preferably the one with the same uid */
+        for (c = w_cfg; c->tab != TABS_END; c++) {
+            if ((c->tab == tab) && (c->uid == w->cfg->uid) &&
+                        widget_cfg_match(w->cfg, c) &&
+                        (get_active_widget(c) == NULL))
+                break;
+        }
+        if (c->tab == TABS_END) {
+            for (c = w_cfg; c->tab != TABS_END; c++) {
+                if ((c->tab == tab) && widget_cfg_match(w->cfg, c) &&
+                            (get_active_widget(c) == NULL))
+                    break;
+            }
+        }
+
+        if (c->tab == TABS_END) {
+            erase_canvas(&w->ca);
+            close_widget(w);
+            continue;
+        }
+
+        if (widget_cfg_moved(w->cfg, c))
+            erase_canvas(&w->ca);
+        /* owners of kept widgets may be swapped, rename in two passes */
+        widget_mem_set_owner(WIDGET_OWNER(w->cfg), WIDGET_OWNER_TMP(n));
+        w->cfg = c;
+        /* text layers leave the canvas at the last span drawn */
+        if (w->ca.rows > 0)
+            w->ca.width = w->ca.area_width;
+        active_widgets[n++] = w;
+    }
+    total_active_widgets = n;
+
+    for (i = 0; i < n; i++)
+        widget_mem_set_owner(WIDGET_OWNER_TMP(i), WIDGET_OWNER(active_widgets[i]->cfg));
+
+    /* canvases are re-allocated for all widgets */
+    free_mem();
+
+    for (c = w_cfg; c->tab != TABS_END; c++) {
+        if ((c->tab == tab) && (get_active_widget(c) == NULL))
+            load_widget_config(c);
+    }
+    load_widgets();
+}
+
+/* resumable rendering: a render may return before finishing the frame
+ * when widget_slice_expired() tells it so. it is called again later
+ * with w->slice_pos holding whatever progress it saved. the canvas is
+ * only committed after the last slice. */
+static unsigned long slice_start;
+
+unsigned char widget_slice_expired(struct widget *w)
+{
+    if ((get_micros() - slice_start) < WIDGET_SLICE_TIME)
+        return 0;
+    w->status |= WIDGET_RENDER_MORE;
+    return 1;
+}
+
+/* text layer widgets commit one changed row per pass */
+void widget_text_commit(struct widget *w, struct text_layer *t)
+{
+    if (!t->drawn)
+        w->status |= WIDGET_RENDER_SKIP;
+    else if (t->pending)
+        w->status |= WIDGET_RENDER_AGAIN;
+}
+
+/* returns 1 if the previous frame is still being uploaded */
+static inline unsigned char render_widget(struct widget *w)
+{
+    struct widget_stats *s = w->stats;
+    u16 dt;
+
+    if ((w->status & WIDGET_RENDER_MORE) == 0) {
+        /* new frame */
+        if (init_canvas(&w->ca)) {
+            if (w->ca.size == 0) {
+                w->status = 0;
+                return 0;
+            }
+            return 1;
+        }
+        s->queue_time += get_micros() - s->sched_time;
+        /* previous frame upload is done */
+        s->pipe_time += w->ca.pipe_wait;
+        w->ca.pipe_wait = 0;
+        w->slice_pos = 0;
+        w->frame_time = 0;
+    }
+
+    w->status &= ~(WIDGET_RENDER_MORE | WIDGET_RENDER_SKIP | WIDGET_RENDER_AGAIN);
+    slice_start = get_micros();
+    w->ops->render(w);
+    dt = (u16) min(get_micros() - slice_start, 0xffff);
+    gov.render_time += dt;
+    w->frame_time = (u16) min((u32) w->frame_time + dt, 0xffff);
+
+    if (w->status & WIDGET_RENDER_MORE) {
+        s->slices++;
+        return 0;
+    }
+
+    dt = w->frame_time;
+    s->total_time += dt;
+    s->renders++;
+    if (dt < s->min_time)
+        s->min_time = dt;
+    if (dt > s->max_time)
+        s->max_time = dt;
+
+    if (w->status & WIDGET_RENDER_SKIP) {
+        w->status = 0;
+        return 0;
+    }
+
+    if ((selected_widget == w) && (w->ca.rows == 0)) {
+        draw_rect(0, 0, w->ca.width-1, w->ca.height-1, ((get_millis16()/500) & 1) ? 3 : 1, &w->ca);
+        /* kept buffers get the selection removed on the next frame */
+        if (w->ca.keep)
+            w->ca.fresh = 1;
+    }
+    schedule_canvas(&w->ca);
+    /* text layers upload the next changed row through the same canvas */
+    w->status = (w->status & WIDGET_RENDER_AGAIN) ? WIDGET_SCHEDULED : 0;
+    return 0;
 }
 
 extern volatile unsigned char sram_busy;
 
+/* first ready slot starting at from, wrapping around */
+static unsigned char ready_find(u16 *set, unsigned char from)
+{
+    unsigned char i, n;
+    u16 m;
+
+    if (from >= MAX_ACTIVE_WIDGETS)
+        from = 0;
+    n = from >> 4;
+    m = set[n] & (0xffff << (from & 0xf));
+    for (i = 0; i <= WIDGET_READY_WORDS; i++) {
+        if (m)
+            return (n << 4) + __builtin_ff1r(m) - 1;
+        if (++n == WIDGET_READY_WORDS)
+            n = 0;
+        m = set[n];
+    }
+    return 0xff;
+}
+
+static inline void ready_add(struct widget *w, unsigned char prio)
+{
+    w->ready_prio = prio;
+    wready.set[prio][w->slot >> 4] |= (1 << (w->slot & 0xf));
+}
+
+static inline void ready_del(struct widget *w)
+{
+    wready.set[w->ready_prio][w->slot >> 4] &= ~(1 << (w->slot & 0xf));
+}
+
+/* highest priority ready widget, round robin within the priority */
+static struct widget* get_ready_widget(void)
+{
+    struct widget *w;
+    unsigned char p, slot;
+
+    for (p = WIDGET_READY_PRIOS; p-- > 0; ) {
+        slot = ready_find(wready.set[p], wready.cursor[p]);
+        if (slot == 0xff)
+            continue;
+        w = slot_widgets[slot];
+        ready_del(w);
+        wready.cursor[p] = slot + 1;
+        wready.count--;
+        return w;
+    }
+    return NULL;
+}
+
 static void widgets_process(void)
 {
     struct widget *w;
+    unsigned long t = get_micros();
+    unsigned char locked[MAX_ACTIVE_WIDGETS];
+    unsigned char i, nlocked = 0;
 
-    if (wfifo.rd == wfifo.wr)
-        return;
-    //while (wfifo.rd != wfifo.wr) {
-    w = wfifo.fifo[wfifo.rd++];
-    wfifo.rd &= WIDGET_FIFO_MASK;
-    render_widget(w);
-    //    if (!sram_busy)
-    //        break;
-    //}
+    /* render while there is budget and room in the canvas pipe */
+    do {
+        if (canvas_pipe_count() >= WIDGETS_MAX_PIPE)
+            break;
+        w = get_ready_widget();
+        if (w == NULL)
+            break;
+        if (render_widget(w)) {
+            /* canvas still uploading: park it so that lower
+               priority widgets get their turn */
+            locked[nlocked++] = w->slot;
+            continue;
+        }
+        if (w->status & WIDGET_SCHEDULED) {
+            /* slice yielded: resume on the next call,
+               let other processes run */
+            ready_add(w, w->ready_prio);
+            wready.count++;
+            break;
+        }
+    } while ((get_micros() - t) < WIDGETS_RENDER_BUDGET);
+
+    for (i = 0; i < nlocked; i++) {
+        w = slot_widgets[locked[i]];
+        ready_add(w, w->ready_prio);
+        wready.count++;
+    }
+}
+
+static unsigned char get_widget_prio(struct widget *w)
+{
+    if (w->cfg->sched.prio != WIDGET_PRIO_DEFAULT)
+        return w->cfg->sched.prio;
+    else if (w->ops->prio != WIDGET_PRIO_DEFAULT)
+        return w->ops->prio;
+    else
+        return WIDGET_PRIO_NORMAL;
 }
 
 void schedule_widget(struct widget *w)
 {
-    if (w->status == WIDGET_SCHEDULED)
+    u16 now;
+
+    if (w->status & WIDGET_SCHEDULED) {
+        wready.merged++;
         return;
+    }
+
+    /* throttled by the governor */
+    now = get_millis16();
+    if ((w->interval > 0) && ((u16) (now - w->last_sched) < w->interval)) {
+        if ((w->status & WIDGET_DEFERRED) == 0) {
+            w->status |= WIDGET_DEFERRED;
+            gov.deferred++;
+        }
+        return;
+    }
 
+    w->last_sched = now;
     w->status = WIDGET_SCHEDULED;
-    wfifo.fifo[wfifo.wr++] = w;
-    wfifo.wr &= WIDGET_FIFO_MASK;
-    wfifo.peak = max(wfifo.peak, wfifo.wr - wfifo.rd);
+    w->stats->sched_time = get_micros();
+    ready_add(w, get_widget_prio(w) - 1);
+    wready.count++;
+    wready.peak = max(wready.peak, wready.count);
+}
+
+/* minimum time between renders for the current governor level */
+static u16 get_widget_interval(struct widget *w)
+{
+    unsigned char prio = get_widget_prio(w);
+    unsigned char rate = w->cfg->sched.min_rate;
+    u16 interval;
+
+    if ((gov.level == 0) || (prio == WIDGET_PRIO_HIGH))
+        return 0;
+
+    if (prio == WIDGET_PRIO_NORMAL) {
+        /* normal priority widgets are throttled only on heavy load */
+        if (gov.level < 2)
+            return 0;
+        interval = GOV_STEP << (gov.level - 2);
+    } else {
+        interval = GOV_STEP << (gov.level - 1);
+    }
+
+    if (rate == 0)
+        rate = GOV_DEFAULT_MIN_RATE;
+    return min(interval, 1000 / rate);
+}
+
+static void governor_timer(struct timer *t, void *d)
+{
+    struct widget *w;
+    unsigned long nbusy, upload;
+    unsigned char i;
+    u16 now;
+
+    /* cpu time used by widget rendering */
+    gov.cpu = (unsigned char) min(gov.render_time / (GOV_PERIOD * 10), 100);
+    gov.render_time = 0;
+
+    /* sram upload window used by the render process */
+    nbusy = nbusy_time - gov.last_nbusy;
+    upload = render_time - gov.last_upload;
+    gov.last_nbusy = nbusy_time;
+    gov.last_upload = render_time;
+    gov.upload = (nbusy > 0) ? (unsigned char) min((upload * 100) / nbusy, 100) : 0;
+
+    gov.queue = wready.count + canvas_pipe_count();
+
+    if ((gov.cpu > GOV_CPU_HIGH) || (gov.upload > GOV_UPLOAD_HIGH) ||
+                (gov.queue > GOV_QUEUE_HIGH)) {
+        if (gov.level < GOV_MAX_LEVEL)
+            gov.level++;
+        gov.relax = 0;
+    } else if ((gov.cpu < GOV_CPU_LOW) && (gov.upload < GOV_UPLOAD_LOW) &&
+                (gov.queue < GOV_QUEUE_LOW)) {
+        if ((gov.level > 0) && (++gov.relax >= GOV_RELAX_WINDOWS)) {
+            gov.level--;
+            gov.relax = 0;
+        }
+    } else {
+        gov.relax = 0;
+    }
+
+    /* update widget intervals and release deferred renders */
+    now = get_millis16();
+    for (i = 0; i < total_active_widgets; i++) {
+        w = active_widgets[i];
+        w->interval = get_widget_interval(w);
+
+        /* promote renders waiting for too long */
+        if ((w->status & WIDGET_SCHEDULED) &&
+                (w->ready_prio != WIDGET_READY_PRIOS - 1) &&
+                ((get_micros() - w->stats->sched_time) > WIDGET_STARVE_TIME)) {
+            ready_del(w);
+            ready_add(w, WIDGET_READY_PRIOS - 1);
+            wready.starved++;
+        }
+
+        if ((w->status & WIDGET_DEFERRED) &&
+                ((u16) (now - w->last_sched) >= w->interval)) {
+            w->status &= ~WIDGET_DEFERRED;
+            schedule_widget(w);
+        }
+    }
 }
 
 void reconfig_widget(struct widget *w)
 {
     if (w->ops->render) {
         reconfig_canvas(&w->ca, w->cfg);
-        w->ops->render(w);
+        schedule_widget(w);
     }
 }
 
@@ -247,16 +912,17 @@ void widgets_reset(void)
     remove_timers(TIMER_WIDGET);
     /* remove widget related mavlink callbacks */
     del_mavlink_callbacks(CALLBACK_WIDGET);
-    /* reset widget fifo */
-    wfifo.rd = wfifo.wr = 0;
-    /* reset widgets mem allocator */
-    widgets_mem.alloc_size = 0;
+    /* reset ready set */
+    memset(&wready.set, 0, sizeof(wready.set));
+    wready.count = 0;
     /* release all canvas memory */
     free_mem();
+    widget_mem_compact();
     /* clear display */
     clear_sram();
     
     selected_widget = NULL;
+    stats_start = get_millis();
 }
 
 extern struct alceosd_config config;
@@ -274,6 +940,8 @@ enum {
     WID_PARAM_PARAM2,
     WID_PARAM_PARAM3,
     WID_PARAM_PARAM4,
+    WID_PARAM_PRIO,
+    WID_PARAM_MINRATE,
     WID_PARAM_END
 };
 
@@ -290,6 +958,8 @@ const char widget_param_lut[WID_PARAM_END][10] = {
     [WID_PARAM_PARAM2] = "PARAM2",
     [WID_PARAM_PARAM3] = "PARAM3",
     [WID_PARAM_PARAM4] = "PARAM4",
+    [WID_PARAM_PRIO] = "PRIO",
+    [WID_PARAM_MINRATE] = "MINRATE",
 };
 
 
@@ -342,6 +1012,14 @@ static void get_widget_param(unsigned int pidx,
             p->type = MAV_PARAM_TYPE_UINT16;
             pv->param_uint16 = wcfg->params[pidx - WID_PARAM_PARAM1];
             break;
+        case WID_PARAM_PRIO:
+            p->type = MAV_PARAM_TYPE_UINT8;
+            pv->param_uint8 = wcfg->sched.prio;
+            break;
+        case WID_PARAM_MINRATE:
+            p->type = MAV_PARAM_TYPE_UINT8;
+            pv->param_uint8 = wcfg->sched.min_rate;
+            break;
         default:
             break;
     }
@@ -397,6 +1075,12 @@ static int set_widget_param(struct widget_config *wcfg, struct param_def *p, cha
         case WID_PARAM_PARAM4:
             wcfg->params[i - WID_PARAM_PARAM1] = (unsigned int) v; //pv->param_uint16;
             break;
+        case WID_PARAM_PRIO:
+            wcfg->sched.prio = (unsigned char) v;
+            break;
+        case WID_PARAM_MINRATE:
+            wcfg->sched.min_rate = (unsigned char) v;
+            break;
     }
     return (int) i;
 }
@@ -440,6 +1124,7 @@ static int widgets_set_params(struct param_def *p)
     struct widget_config *wcfg = config.widgets;
     const struct widget_ops *wops;
     const struct widget_ops **w = all_widget_ops;
+    struct widget *aw;
 
     unsigned int idx = 0;
     int ret = -1;
@@ -469,6 +1154,10 @@ static int widgets_set_params(struct param_def *p)
     while (wcfg->tab != TABS_END) {
         if ((uid == wcfg->uid) && (wops->id == wcfg->widget_id)) {
             ret = set_widget_param(wcfg, p, pname);
+            /* move loaded widgets live */
+            aw = get_active_widget(wcfg);
+            if ((aw != NULL) && (ret >= WID_PARAM_X) && (ret <= WID_PARAM_VJUST))
+                reconfig_widget(aw);
             break;
         }
         idx++;
@@ -522,17 +1211,166 @@ void widgets_init(void)
         w++;
     }
     process_add(widgets_process, "WIDGETS", 10);
+    add_timer(TIMER_ALWAYS, GOV_PERIOD, governor_timer, NULL);
 }
 
 
+static void widgets_reset_stats(void)
+{
+    unsigned char i;
+
+    memset(widget_stats, 0, sizeof(widget_stats));
+    for (i = 0; i < MAX_ACTIVE_WIDGETS; i++)
+        widget_stats[i].min_time = 0xffff;
+    stats_start = get_millis();
+}
+
+static void send_stats_value(struct widget *w, char *id, s32 value)
+{
+    mavlink_message_t msg;
+    char name[11];
+
+    sprintf(name, "W%02u%1u%s", w->ops->id, w->cfg->uid, id);
+    mavlink_msg_named_value_int_pack(config.mav.osd_sysid, MAV_COMP_ID_OSD, &msg,
+                                    get_millis(), name, value);
+    mavlink_send_msg(&msg);
+}
+
+/* sends one widget stats per call as named values */
+static void send_stats_cbk(struct timer *t, void *d)
+{
+    struct widget *w;
+    struct widget_stats *s;
+    unsigned long dt = get_millis() - stats_start;
+
+    if (total_active_widgets == 0)
+        return;
+    if (stats_idx >= total_active_widgets)
+        stats_idx = 0;
+
+    w = active_widgets[stats_idx++];
+    s = w->stats;
+    if (s->renders == 0)
+        return;
+
+    send_stats_value(w, "AVG", s->total_time / s->renders);
+    send_stats_value(w, "MAX", s->max_time);
+    send_stats_value(w, "RPS", dt ? (u32) ((float) s->renders * 1000 / dt) : 0);
+    send_stats_value(w, "QUEUE", s->queue_time / s->renders);
+    send_stats_value(w, "PIPE", s->pipe_time / s->renders);
+}
+
+static void widget_mem_stats(void)
+{
+    struct widget_mem_hdr *h;
+    unsigned int i = 0;
+    unsigned int blocks[WIDGET_MEM_CLASSES + 1], used[WIDGET_MEM_CLASSES + 1];
+    unsigned int parked[WIDGET_MEM_CLASSES + 1];
+    unsigned char c;
+
+    memset(blocks, 0, sizeof(blocks));
+    memset(used, 0, sizeof(used));
+    memset(parked, 0, sizeof(parked));
+    while (i < widgets_mem.alloc_size) {
+        h = (struct widget_mem_hdr*) &widgets_mem.mem[i];
+        blocks[h->cls]++;
+        if (h->flags & WIDGET_MEM_PARKED)
+            parked[h->cls]++;
+        else if (h->flags & WIDGET_MEM_USED)
+            used[h->cls]++;
+        i += sizeof(struct widget_mem_hdr) + h->size;
+    }
+
+    shell_printf(" class | blocks | used | parked\n");
+    for (c = 0; c < WIDGET_MEM_CLASSES + 1; c++) {
+        if (blocks[c] == 0)
+            continue;
+        if (c == WIDGET_MEM_LARGE)
+            shell_printf(" large | %6u | %4u | %6u\n", blocks[c], used[c], parked[c]);
+        else
+            shell_printf(" %5u | %6u | %4u | %6u\n",
+                widget_mem_class_size[c], blocks[c], used[c], parked[c]);
+    }
+}
+
+#define SHELL_CMD_STATS_ARGS 2
 static void shell_cmd_stats(char *args, void *data)
 {
-    shell_printf("Widgets mem: %u/%u bytes\n",
-        widgets_mem.alloc_size, MAX_WIDGET_ALLOC_MEM);
+    struct shell_argval argval[SHELL_CMD_STATS_ARGS+1], *p;
+    struct widget_stats *s;
+    struct widget *w;
+    unsigned long dt;
+    unsigned int period;
+    unsigned char i;
 
-    shell_printf("Widgets fifo: size=%u peak=%u max=%u\n",
-                (wfifo.wr - wfifo.rd) & WIDGET_FIFO_MASK, wfifo.peak, WIDGET_FIFO_MASK+1);
-    
+    shell_arg_parser(args, argval, SHELL_CMD_STATS_ARGS);
+
+    p = shell_get_argval(argval, 'm');
+    if (p != NULL) {
+        period = atoi(p->val);
+        if (stats_tmr != NULL) {
+            remove_timer(stats_tmr);
+            stats_tmr = NULL;
+        }
+        if (period > 0)
+            stats_tmr = add_timer(TIMER_ALWAYS, period, send_stats_cbk, NULL);
+        shell_printf("Widgets stats mavlink period: %ums\n", period);
+        return;
+    }
+
+    shell_printf("syntax: widgets stats [-r] [-m <period>]\n");
+    shell_printf("      -r              reset render stats\n");
+    shell_printf("      -m <period>     send stats as mavlink named values (ms, 0=off)\n\n");
+
+    shell_printf("Widgets mem: used=%u peak=%u pool=%u/%u bytes fails=%u\n",
+        widgets_mem.used, widgets_mem.peak,
+        widgets_mem.alloc_size, MAX_WIDGET_ALLOC_MEM, widgets_mem.fails);
+    widget_mem_stats();
+
+    shell_printf("Widgets ready: count=%u peak=%u merged=%lu starved=%lu\n",
+                wready.count, wready.peak, wready.merged, wready.starved);
+
+    shell_printf("Widgets governor: level=%u cpu=%u%% upload=%u%% queue=%u deferred=%lu\n",
+                gov.level, gov.cpu, gov.upload, gov.queue, gov.deferred);
+
+    dt = get_millis() - stats_start;
+    shell_printf("\nRender stats (times in us, %lums window):\n", dt);
+    shell_printf("\n id+uid | name                 |   min |   avg |   max |  rps | slices\n");
+    shell_printf(  "--------+----------------------+-------+-------+-------+------+-------\n");
+    for (i = 0; i < total_active_widgets; i++) {
+        w = active_widgets[i];
+        s = w->stats;
+        if (s->renders == 0) {
+            shell_printf("  %02u+%02u | %20s |     - |     - |     - |    0 | %6u\n",
+                w->ops->id, w->cfg->uid, w->ops->name, s->slices);
+            continue;
+        }
+        shell_printf("  %02u+%02u | %20s | %5u | %5lu | %5u | %4.1f | %6u\n",
+            w->ops->id, w->cfg->uid, w->ops->name,
+            s->min_time, s->total_time / s->renders, s->max_time,
+            dt ? (float) s->renders * 1000.0 / dt : 0.0, s->slices);
+    }
+
+    shell_printf("\n id+uid | bytes |  queue |   pipe | ivl\n");
+    shell_printf(  "--------+-------+--------+--------+-----\n");
+    for (i = 0; i < total_active_widgets; i++) {
+        w = active_widgets[i];
+        s = w->stats;
+        if (s->renders == 0) {
+            shell_printf("  %02u+%02u | %5u |      - |      - | %3u\n",
+                w->ops->id, w->cfg->uid, w->ca.size, w->interval);
+            continue;
+        }
+        shell_printf("  %02u+%02u | %5u | %6lu | %6lu | %3u\n",
+            w->ops->id, w->cfg->uid, w->ca.size,
+            s->queue_time / s->renders, s->pipe_time / s->renders, w->interval);
+    }
+
+    p = shell_get_argval(argval, 'r');
+    if (p != NULL) {
+        widgets_reset_stats();
+        shell_printf("\nstats reset\n");
+    }
 }
 
 static void shell_cmd_loaded(char *args, void *data)
@@ -694,6 +1532,7 @@ static void shell_cmd_add(char *args, void *data)
             w_cfg->x = 0;
             w_cfg->y = 0;
             w_cfg->props.raw = JUST_VCENTER | JUST_HCENTER;
+            w_cfg->sched.raw = 0;
 
             w_cfg++;
             w_cfg->tab = TABS_END;
@@ -787,7 +1626,7 @@ static void shell_cmd_bitmap(char *args, void *data)
     }
 }
 
-#define SHELL_CMD_CFG_ARGS 13
+#define SHELL_CMD_CFG_ARGS 15
 static void shell_cmd_config(char *args, void *data)
 {
     struct shell_argval argval[SHELL_CMD_CFG_ARGS+1], *p;
@@ -816,7 +1655,10 @@ static void shell_cmd_config(char *args, void *data)
         shell_printf("      -a <value>      param1 value\n");
         shell_printf("      -b <value>      param2 value\n");
         shell_printf("      -c <value>      param3 value\n");
-        shell_printf("      -d <value>      param4 value\n\n");
+        shell_printf("      -d <value>      param4 value\n");
+
+        shell_printf("      -p <prio>       refresh priority (0=default 1=low 2=normal 3=high)\n");
+        shell_printf("      -f <rate>       minimum refresh rate when throttled (Hz, 0=default)\n\n");
     } else {
         /* widget id+uid */
         ptr = strchr(p->val, '+');
@@ -843,9 +1685,10 @@ static void shell_cmd_config(char *args, void *data)
                     w_cfg->props.hjust, w_cfg->props.vjust);
             shell_printf("m:%u s:%u u:%u ", w_cfg->props.mode,
                     w_cfg->props.source, w_cfg->props.units);
-            shell_printf("a:%u b:%u c:%u d:%u\n",
+            shell_printf("a:%u b:%u c:%u d:%u ",
                     w_cfg->params[0], w_cfg->params[1],
                     w_cfg->params[2], w_cfg->params[3]);
+            shell_printf("p:%u f:%u\n", w_cfg->sched.prio, w_cfg->sched.min_rate);
             return;
         }
         
@@ -907,6 +1750,12 @@ static void shell_cmd_config(char *args, void *data)
                 case 'd':
                     w_cfg->params[3] = val;
                     break;
+                case 'p':
+                    w_cfg->sched.prio = (val & 3);
+                    break;
+                case 'f':
+                    w_cfg->sched.min_rate = (val & 0x1f);
+                    break;
                 default:
                     break;
             }
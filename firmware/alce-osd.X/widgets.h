@@ -50,6 +50,23 @@ enum {
 };
 
 #define WIDGET_SCHEDULED    (0x1)
+#define WIDGET_DEFERRED     (0x2)
+#define WIDGET_RENDER_MORE  (0x4)
+/* nothing changed, keep what is on screen */
+#define WIDGET_RENDER_SKIP  (0x8)
+/* commit the canvas and render again once it is uploaded */
+#define WIDGET_RENDER_AGAIN (0x10)
+
+/* render time slice (us) */
+#define WIDGET_SLICE_TIME   (1000)
+
+/* refresh governor priorities */
+enum {
+    WIDGET_PRIO_DEFAULT = 0,
+    WIDGET_PRIO_LOW,
+    WIDGET_PRIO_NORMAL,
+    WIDGET_PRIO_HIGH,
+};
 
 typedef union {
     unsigned int raw;
@@ -63,22 +80,35 @@ typedef union {
     };
 } widget_props;
 
+typedef union {
+    unsigned char raw;
+    struct {
+        /* minimum refresh rate (Hz) when throttled, 0=default */
+        unsigned char min_rate:5;
+        unsigned char :1;
+        unsigned char prio:2;
+    };
+} widget_sched;
+
 
 struct widget_config {
     unsigned char tab;
     unsigned char uid;
     unsigned char widget_id;
+    widget_sched sched;
     int x, y;
     widget_props props;
     unsigned int params[4];
 };
 
 struct widget;
+struct text_layer;
 
 struct widget_ops {
     unsigned int id;
     char name[20];
     char mavname[8];
+    unsigned char prio;
 
     void (*init)(void);
     int (*open)(struct widget *w);
@@ -86,21 +116,48 @@ struct widget_ops {
     void (*close)(struct widget *w);
 };
 
+struct widget_stats {
+    /* render time (us) */
+    u16 min_time, max_time;
+    u32 total_time;
+    u32 renders;
+    u16 slices;
+    /* time queued for rendering and in the canvas pipe (us) */
+    u32 sched_time;
+    u32 queue_time;
+    u32 pipe_time;
+};
+
 struct widget {
     const struct widget_ops *ops;
     struct widget_config *cfg;
     void *priv;
     struct canvas ca;
+    /* optional pre-rendered canvas, allocated along with ca */
+    struct canvas *aux;
     unsigned int status;
+    struct widget_stats *stats;
+    /* resumable rendering progress */
+    int slice_pos;
+    u16 frame_time;
+    /* ready set slot and priority */
+    unsigned char slot, ready_prio;
+    /* refresh governor */
+    u16 interval, last_sched;
 };
 
 void widgets_init(void);
 void widgets_reset(void);
+void widgets_switch_tab(struct widget_config *w_cfg, unsigned char tab);
 struct widget* load_widget_config(struct widget_config *w_cfg);
 void load_widgets(void);
 void schedule_widget(struct widget *w);
 const struct widget_ops *get_widget_ops(unsigned int id);
+unsigned char widget_slice_expired(struct widget *w);
+void widget_text_commit(struct widget *w, struct text_layer *t);
 void* widget_malloc(unsigned int size);
+void* widget_malloc_state(unsigned int size, unsigned char *restored);
+void widget_free(void *ptr);
 unsigned char widget_get_uid(unsigned char wid);
 void shell_cmd_widgets(char *args, void *data);
 
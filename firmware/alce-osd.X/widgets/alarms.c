@@ -26,6 +26,7 @@ struct widget_priv {
     s16 x, i;
     u8 blink;
     u8 wait;
+    u8 blank;
     u16 active_alarms;
     u16 display[MAX_FLIGHT_ALARMS];
 };
@@ -92,6 +93,7 @@ static void render(struct widget *w)
     s16 z;
 
     if (priv->active_alarms != 0) {
+        priv->blank = 0;
         if (priv->blink < BLINK_CNT) {
             draw_rect(0, 0, X_SIZE-1, Y_SIZE-1, 3, ca);
             draw_rect(1, 1, X_SIZE-2, Y_SIZE-2, 1, ca);
@@ -151,12 +153,18 @@ static void render(struct widget *w)
     } else {
         priv->blink = 0;
         priv->x = 0;
+        /* the empty frame is already on screen */
+        if (priv->blank && !ca->fresh)
+            w->status |= WIDGET_RENDER_SKIP;
+        priv->blank = 1;
+        ca->fresh = 0;
     }
 }
 
 const struct widget_ops alarms_widget_ops = {
     .name = "Flight Alarms",
     .mavname = "ALARMS",
+    .prio = WIDGET_PRIO_HIGH,
     .id = WIDGET_ALARMS_ID,
     .init = NULL,
     .open = open,
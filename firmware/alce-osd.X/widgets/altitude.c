@@ -23,10 +23,16 @@
 #define X_CENTER    (X_SIZE/2) - 15
 #define Y_CENTER    (Y_SIZE/2) - 1
 
+/* pre-rendered tape rows */
+#define TAPE_ROWS   (Y_SIZE*3)
+
 
 struct widget_priv {
-    long altitude;
+    float altitude;
     int range;
+    /* pre-rendered tape and the value at its first row */
+    struct canvas tape;
+    long tape_top;
 };
 
 
@@ -76,7 +82,7 @@ static void pre_render(struct timer *t, void *d)
     if (get_units(w->cfg) == UNITS_IMPERIAL)
         altitude *= M2FEET;
     
-    priv->altitude = (long) altitude;
+    priv->altitude = altitude;
     schedule_widget(w);
 }
 
@@ -108,6 +114,9 @@ static int open(struct widget *w)
         default:
             w->ca.width = X_SIZE;
             w->ca.height = Y_SIZE;
+            priv->tape.width = X_SIZE;
+            priv->tape.height = TAPE_ROWS;
+            w->aux = &priv->tape;
             break;
         case 1:
             w->ca.width = 64;
@@ -119,33 +128,60 @@ static int open(struct widget *w)
 }
 
 
-static void render_gauge(struct widget *w)
+/* ticks and labels of a tape whose first row is the value top */
+static void draw_tape(struct widget *w, struct canvas *ca, long top)
 {
     struct widget_priv *priv = w->priv;
-    struct canvas *ca = &w->ca;
-    int i, j, y = -1;
-    long yy;
-    char buf[10], d = 0;
+    int y;
+    long j, bot;
+    char buf[10];
     int major_tick = priv->range / 5;
     int minor_tick = major_tick / 4;
 
-    for (i = 0; i < priv->range; i++) {
-        yy = ((long) i * Y_SIZE) / priv->range;
-        if ((yy == y) && (d == 1))
-            continue;
-        y = Y_SIZE - (int) yy;
-        j = priv->altitude + i - priv->range/2;
+    bot = top - ((long) ca->height * priv->range) / Y_SIZE;
+
+    /* include ticks just outside so labels are not cut */
+    j = bot - minor_tick;
+    j -= j % minor_tick;
+    for (; j <= top + minor_tick; j += minor_tick) {
+        y = (int) (((top - j) * Y_SIZE) / priv->range);
         if (j % major_tick == 0) {
             draw_oline(X_CENTER + 2, y, X_CENTER - 4, y, 1, ca);
-            sprintf(buf, "%d", j);
+            sprintf(buf, "%ld", j);
             draw_jstr(buf, X_SIZE-2, y, JUST_RIGHT | JUST_VCENTER, ca, 0);
-            d = 1;
-        } else if (j % minor_tick == 0) {
-            draw_oline(X_CENTER + 2, y, X_CENTER - 2, y, 1, ca);
-            d = 1;
         } else {
-            d = 0;
+            draw_oline(X_CENTER + 2, y, X_CENTER - 2, y, 1, ca);
+        }
+    }
+}
+
+static inline int get_tape_row(struct widget_priv *priv)
+{
+    return (int) ((priv->tape_top - priv->altitude) * Y_SIZE / priv->range) - Y_SIZE/2;
+}
+
+static void render_gauge(struct widget *w)
+{
+    struct widget_priv *priv = w->priv;
+    struct canvas *ca = &w->ca;
+    struct canvas *tape = &priv->tape;
+    char buf[10];
+    int y;
+
+    if (tape->size > 0) {
+        y = get_tape_row(priv);
+        if (tape->fresh || (y < 0) || (y > (TAPE_ROWS - Y_SIZE))) {
+            /* out of the pre-rendered range, center it on the value */
+            priv->tape_top = (long) priv->altitude +
+                    ((long) (TAPE_ROWS/2) * priv->range) / Y_SIZE;
+            init_canvas(tape);
+            draw_tape(w, tape, priv->tape_top);
+            tape->fresh = 0;
+            y = get_tape_row(priv);
         }
+        copy_canvas(ca, 0, tape, 0, y);
+    } else {
+        draw_tape(w, ca, (long) priv->altitude + priv->range/2);
     }
 
     draw_frect(X_CENTER + 11, Y_CENTER-5, X_SIZE-2, Y_CENTER + 5, 0, ca);
@@ -158,7 +194,7 @@ static void render_gauge(struct widget *w)
     draw_line(X_CENTER+10, Y_CENTER-6, X_CENTER+10-5, Y_CENTER, 1, ca);
     draw_line(X_CENTER+10, Y_CENTER+6, X_CENTER+10-5, Y_CENTER, 1, ca);
 
-    sprintf(buf, "%d", (unsigned int) priv->altitude);
+    sprintf(buf, "%d", (int) priv->altitude);
     draw_jstr(buf, X_SIZE-2, Y_CENTER, JUST_RIGHT | JUST_VCENTER, ca, 0);
 }
 
@@ -169,7 +205,7 @@ static void render_text(struct widget *w)
     struct canvas *ca = &w->ca;
     char buf[10];
     
-    sprintf(buf, "%d", (unsigned int) priv->altitude);
+    sprintf(buf, "%d", (int) priv->altitude);
     draw_jstr(buf, 64, 10, JUST_RIGHT | JUST_VCENTER, ca, 1);
 }
 
@@ -28,9 +28,14 @@
 #define X_CENTER    (X_SIZE/2) - 2
 #define Y_CENTER    (Y_SIZE/2) - 1
 
+/* pre-rendered tape: a full turn plus one window of wrap around */
+#define TAPE_WIDTH  (360 + X_SIZE)
+#define TAPE_HEIGHT (Y_SIZE - (Y_CENTER))
+
 struct widget_priv {
     int heading;
     char heading_s[4];
+    struct canvas tape;
 };
 
 static void render_callback(struct timer *t, void *d)
@@ -38,8 +43,20 @@ static void render_callback(struct timer *t, void *d)
     struct widget *w = d;
     struct widget_priv *priv = w->priv;
     mavlink_vfr_hud_t *vfr_hud = mavdata_get(MAVLINK_MSG_ID_VFR_HUD);
+    struct mavdata_attitude att;
+    int heading;
+
+    /* extrapolated yaw when attitude is available */
+    if (mavdata_time(MAVLINK_MSG_ID_ATTITUDE) != 0) {
+        mavdata_get_attitude(&att);
+        heading = ((int) RAD2DEG(att.yaw) + 360) % 360;
+    } else {
+        heading = vfr_hud->heading;
+    }
+    if ((heading == priv->heading) && (priv->heading_s[0] != '\0'))
+        return;
     
-    priv->heading = vfr_hud->heading;
+    priv->heading = heading;
     priv->heading_s[0] = '0' + (priv->heading / 100);
     priv->heading_s[1] = '0' + ((priv->heading % 100) / 10);
     priv->heading_s[2] = '0' + (priv->heading % 10);
@@ -59,40 +76,62 @@ static int open(struct widget *w)
     priv->heading_s[3] = '\0';
     w->ca.width = X_SIZE;
     w->ca.height = Y_SIZE;
+    priv->tape.width = TAPE_WIDTH;
+    priv->tape.height = TAPE_HEIGHT;
+    w->aux = &priv->tape;
     
-    add_timer(TIMER_WIDGET, 250, render_callback, w);
+    /* every video field */
+    add_timer(TIMER_WIDGET, 20, render_callback, w);
     return 0;
 }
 
+/* draw len columns of ticks starting at column x with heading h */
+static void draw_tape(struct canvas *ca, int x, int y, int h, int len)
+{
+    const char cardinals[] = {'N', 'E', 'S', 'W'};
+    int j;
+
+    for (; len > 0; len--, x++, h++) {
+        j = (h + 360) % 360;
+        if (j == 0 || j == 90 || j == 180 || j == 270) {
+            draw_vline(x,   y, y + 5, 1, ca);
+            draw_vline(x-1, y, y + 5, 3, ca);
+            draw_vline(x+1, y, y + 5, 3, ca);
+            draw_chr(cardinals[j / 90], x-3, y + 6, ca, 0);
+        } else if(j % MAJOR_TICK == 0) {
+            draw_vline(x,   y, y + 5, 1, ca);
+            draw_vline(x-1, y, y + 5, 3, ca);
+            draw_vline(x+1, y, y + 5, 3, ca);
+        } else if(j % MINOR_TICK == 0) {
+            draw_vline(x,   y, y + 3, 1, ca);
+            draw_vline(x-1, y, y + 3, 3, ca);
+            draw_vline(x+1, y, y + 3, 3, ca);
+        }
+    }
+}
+
 static void render(struct widget *w)
 {
     struct widget_priv *priv = w->priv;
     struct canvas *ca = &w->ca;
-    const char cardinals[] = {'N', 'E', 'S', 'W'};
-    int i, j, x;
+    struct canvas *tape = &priv->tape;
+
+    if (tape->size > 0) {
+        /* drawn once, each frame is a window of it */
+        if (tape->fresh) {
+            init_canvas(tape);
+            draw_tape(tape, 0, 0, -(X_CENTER), TAPE_WIDTH);
+            tape->fresh = 0;
+        }
+        copy_canvas(ca, Y_CENTER, tape, (priv->heading + 360) % 360, 0);
+    } else {
+        draw_tape(ca, X_CENTER - RANGE/2, Y_CENTER, priv->heading - RANGE/2, RANGE + 1);
+    }
 
     draw_jstr(priv->heading_s, X_CENTER, 0, JUST_HCENTER, ca, 1);
     set_pixel(X_CENTER, Y_CENTER-1, 1, ca);
     draw_hline(X_CENTER-1, X_CENTER+1, Y_CENTER-2, 1, ca);
     draw_hline(X_CENTER-2, X_CENTER+2, Y_CENTER-3, 1, ca);
-    for(i = -RANGE / 2; i <= RANGE / 2; i++) {
-        x = X_CENTER + i;
-        j = (priv->heading + i + 360) % 360;
-        if (j == 0 || j == 90 || j == 180 || j == 270) {
-            draw_vline(x,   Y_CENTER, Y_CENTER + 5, 1, ca);
-            draw_vline(x-1, Y_CENTER, Y_CENTER + 5, 3, ca);
-            draw_vline(x+1, Y_CENTER, Y_CENTER + 5, 3, ca);
-            draw_chr(cardinals[j / 90], x-3, Y_CENTER + 6, ca, 0);
-        } else if(j % MAJOR_TICK == 0) {
-            draw_vline(x,   Y_CENTER, Y_CENTER + 5, 1, ca);
-            draw_vline(x-1, Y_CENTER, Y_CENTER + 5, 3, ca);
-            draw_vline(x+1, Y_CENTER, Y_CENTER + 5, 3, ca);
-        } else if(j % MINOR_TICK == 0) {
-            draw_vline(x,   Y_CENTER, Y_CENTER + 3, 1, ca);
-            draw_vline(x-1, Y_CENTER, Y_CENTER + 3, 3, ca);
-            draw_vline(x+1, Y_CENTER, Y_CENTER + 3, 3, ca);
-        }
-    }
 }
 
 
@@ -20,11 +20,10 @@
 
 #define PERSISTENT_BUFFER
 
-#define ROWS    (10)
+#define ROWS    (8)
 #define COLS    (45)
 
 #define X_SIZE  (8*COLS)
-#define Y_SIZE  (13*ROWS)
 
 static struct widget *console = NULL;
 
@@ -32,6 +31,9 @@ struct widget_priv {
     unsigned char x, y;
     char buf[ROWS][COLS];
     s8 line0;
+    /* only changed text is uploaded, the canvas holds a single row */
+    struct text_layer layer;
+    char shown[ROWS][COLS];
 };
 
 #ifdef PERSISTENT_BUFFER
@@ -136,12 +138,12 @@ static int open(struct widget *w)
 #endif
     w->priv = p;
     w->ca.width = X_SIZE;
-    w->ca.height = Y_SIZE;
+    text_layer_init(&p->layer, &w->ca, ROWS, COLS, 1, &p->shown[0][0]);
 
 #ifndef PERSISTENT_BUFFER
     memset(priv.buf, 0, ROWS*COLS);
     priv.line0 = -ROWS;
-    add_mavlink_callback(MAVLINK_MSG_ID_STATUSTEXT, mav_callback, CALLBACK_WIDGET, NULL);
+    add_mavlink_callback(MAVLINK_MSG_ID_STATUSTEXT, mav_callback, CALLBACK_WIDGET, w);
 #endif
     
     console = w;
@@ -171,11 +173,13 @@ static void render(struct widget *w)
     unsigned char y;
     u8 line0 = max(wp->line0, 0);
 
+    text_layer_begin(&wp->layer, ca);
     for (y = 0; y < ROWS; y++) {
-        draw_str(wp->buf[line0], 0, y*12, ca, 1);
+        text_layer_row(&wp->layer, y, wp->buf[line0], ca);
         if (++line0 == ROWS)
             line0 = 0;
     }
+    widget_text_commit(w, &wp->layer);
 }
 
 
@@ -19,6 +19,16 @@
 #include "alce-osd.h"
 
 
+#define ROWS    (9)
+#define COLS    (32)
+
+#define X_SIZE  (4*60)
+
+struct widget_priv {
+    struct text_layer layer;
+    char shown[ROWS][COLS];
+};
+
 static void timer_callback(struct timer *t, void *d)
 {
     struct widget *w = (struct widget*) d;
@@ -28,11 +38,15 @@ static void timer_callback(struct timer *t, void *d)
 
 static int open(struct widget *w)
 {
-    const struct font *f = get_font(1);
-    w->priv = (struct flight_stats*) get_flight_stats();
+    struct widget_priv *priv;
 
-    w->ca.width = 4*60;
-    w->ca.height = f->size*9+4;
+    priv = (struct widget_priv*) widget_malloc(sizeof(struct widget_priv));
+    if (priv == NULL)
+        return -1;
+    w->priv = priv;
+
+    w->ca.width = X_SIZE;
+    text_layer_init(&priv->layer, &w->ca, ROWS, COLS, 1, &priv->shown[0][0]);
 
     /* refresh rate of 0.2 sec */
     add_timer(TIMER_WIDGET, 200, timer_callback, w);
@@ -42,37 +56,43 @@ static int open(struct widget *w)
 
 static void render(struct widget *w)
 {
-    struct flight_stats *priv = w->priv;
+    struct widget_priv *priv = w->priv;
+    struct flight_stats *fs = get_flight_stats();
+    struct text_layer *t = &priv->layer;
     struct canvas *ca = &w->ca;
     char buf[50];
-    unsigned long duration = (priv->flight_end - priv->flight_start) / 1000;
+    unsigned long duration = (fs->flight_end - fs->flight_start) / 1000;
+
+    text_layer_begin(t, ca);
 
-    sprintf(buf, "Distance traveled:     %ld m", (unsigned long) priv->total_distance);
-    draw_str(buf, 0, 0, ca, 1);
+    sprintf(buf, "Distance traveled:     %ld m", (unsigned long) fs->total_distance);
+    text_layer_row(t, 0, buf, ca);
 
-    sprintf(buf, "Maximum altitude:      %d m", priv->max_altitude);
-    draw_str(buf, 0, 12*1, ca, 1);
+    sprintf(buf, "Maximum altitude:      %d m", fs->max_altitude);
+    text_layer_row(t, 1, buf, ca);
     
-    sprintf(buf, "Maximum home altitude: %d m", priv->max_home_altitude);
-    draw_str(buf, 0, 12*2, ca, 1);
+    sprintf(buf, "Maximum home altitude: %d m", fs->max_home_altitude);
+    text_layer_row(t, 2, buf, ca);
 
-    sprintf(buf, "Maximum ground speed:  %d m/s", priv->max_gnd_speed);
-    draw_str(buf, 0, 12*3, ca, 1);
+    sprintf(buf, "Maximum ground speed:  %d m/s", fs->max_gnd_speed);
+    text_layer_row(t, 3, buf, ca);
 
-    sprintf(buf, "Maximum air speed:     %d m/s", priv->max_air_speed);
-    draw_str(buf, 0, 12*4, ca, 1);
+    sprintf(buf, "Maximum air speed:     %d m/s", fs->max_air_speed);
+    text_layer_row(t, 4, buf, ca);
 
-    sprintf(buf, "Maximum home distance: %d m", priv->max_home_distance);
-    draw_str(buf, 0, 12*5, ca, 1);
+    sprintf(buf, "Maximum home distance: %d m", fs->max_home_distance);
+    text_layer_row(t, 5, buf, ca);
 
-    sprintf(buf, "Peak current:          %.2fA", ((double) priv->max_bat_current) / 100);
-    draw_str(buf, 0, 12*6, ca, 1);
+    sprintf(buf, "Peak current:          %.2fA", ((double) fs->max_bat_current) / 100);
+    text_layer_row(t, 6, buf, ca);
 
-    sprintf(buf, "Total used current:    %dmAh", (unsigned int) priv->total_flight_mah);
-    draw_str(buf, 0, 12*7, ca, 1);
+    sprintf(buf, "Total used current:    %dmAh", (unsigned int) fs->total_flight_mah);
+    text_layer_row(t, 7, buf, ca);
 
     sprintf(buf, "Flight duration:       %02dm%02ds", (unsigned int) duration / 60, (unsigned int) duration % 60);
-    draw_str(buf, 0, 12*8, ca, 1);
+    text_layer_row(t, 8, buf, ca);
+
+    widget_text_commit(w, t);
 }
 
 
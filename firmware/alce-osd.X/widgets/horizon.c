@@ -36,26 +36,118 @@
 #define MAJOR_ROLL_TICK  15
 
 
+#define LADDER_TICK     (MINOR_TICK*SCALE)
+#define LADDER_GAP      10
+#define LADDER_LABELS   21
+#define ROLL_GAP        70
+#define ROLL_TICKS      (ROLL_RANGE/MINOR_ROLL_TICK + 1)
+
+/* fixed point scale of the cached sin/cos */
+#define GEO_SHIFT       8
+
+
 struct widget_priv {
     int pitch_deg, roll_deg;
     float cos_roll, sin_roll;
     int heading;
+
+    /* ladder geometry for roll_cache */
+    int roll_cache;
+    int cos_q, sin_q;
+    struct point gap, size[3];
+    struct point ptr0, ptr1;
 };
 
+/* roll scale geometry and label text, the same for all instances */
+static struct {
+    struct point p0, p1;
+    char label[4];
+} roll_scale[ROLL_TICKS];
+
+static char ladder_labels[LADDER_LABELS][5];
+
+static void init(void)
+{
+    unsigned char i;
+    int deg, size;
+    float cos_i, sin_i;
+
+    for (i = 0; i < ROLL_TICKS; i++) {
+        deg = -ROLL_RANGE/2 + i * MINOR_ROLL_TICK;
+        size = (deg % MAJOR_ROLL_TICK == 0) ? 10 : 5;
+        cos_i = cos(DEG2RAD(deg));
+        sin_i = sin(DEG2RAD(deg));
+
+        roll_scale[i].p0.x = X_CENTER + (int) (ROLL_GAP * cos_i);
+        roll_scale[i].p0.y = Y_CENTER - (int) (ROLL_GAP * sin_i);
+        roll_scale[i].p1.x = roll_scale[i].p0.x + (int) (size * cos_i);
+        roll_scale[i].p1.y = roll_scale[i].p0.y - (int) (size * sin_i);
+
+        if ((deg != 0) && (deg % MAJOR_ROLL_TICK == 0))
+            sprintf(roll_scale[i].label, "%d", deg);
+        else
+            roll_scale[i].label[0] = '\0';
+    }
+
+    for (i = 0; i < LADDER_LABELS; i++)
+        sprintf(ladder_labels[i], "%d", (i - LADDER_LABELS/2) * MAJOR_TICK);
+}
+
+/* recompute the ladder geometry only when the roll changes */
+static void update_geometry(struct widget_priv *priv)
+{
+    const unsigned char sizes[] = {10, 20, 40};
+    unsigned char i;
+    float c, s;
+
+    if (priv->roll_cache == priv->roll_deg)
+        return;
+    priv->roll_cache = priv->roll_deg;
+
+    c = cos(DEG2RAD(priv->roll_deg));
+    s = -1 * sin(DEG2RAD(priv->roll_deg));
+    priv->cos_roll = c;
+    priv->sin_roll = s;
+    priv->cos_q = (int) (c * (1 << GEO_SHIFT));
+    priv->sin_q = (int) (s * (1 << GEO_SHIFT));
+
+    priv->gap.x = (int) (LADDER_GAP * c);
+    priv->gap.y = (int) (LADDER_GAP * s);
+    for (i = 0; i < 3; i++) {
+        priv->size[i].x = (int) (sizes[i] * c);
+        priv->size[i].y = (int) (sizes[i] * s);
+    }
+
+    priv->ptr0.x = (int) ((ROLL_GAP - 10) * c);
+    priv->ptr0.y = (int) ((ROLL_GAP - 10) * s);
+    priv->ptr1.x = priv->ptr0.x + (int) (10 * c);
+    priv->ptr1.y = priv->ptr0.y + (int) (10 * s);
+}
+
 static void pre_render(struct timer *t, void *d)
 {
     struct widget *w = d;
     struct widget_priv *priv = w->priv;
-    
-    mavlink_attitude_t *att = mavdata_get(MAVLINK_MSG_ID_ATTITUDE);
-    mavlink_vfr_hud_t *hud = mavdata_get(MAVLINK_MSG_ID_VFR_HUD);
-    
-    priv->pitch_deg = RAD2DEG(att->pitch * SCALE);
-    priv->roll_deg  = RAD2DEG(att->roll);
-    priv->cos_roll = cos(att->roll);
-    priv->sin_roll = -1 * sin(att->roll);
-    priv->heading = hud->heading;
-    
+    struct mavdata_attitude att;
+    int pitch_deg, roll_deg, heading;
+
+    /* keep the frame consistent while it is rendered in slices */
+    if (w->status & WIDGET_RENDER_MORE)
+        return;
+
+    /* attitude extrapolated to now */
+    mavdata_get_attitude(&att);
+    pitch_deg = RAD2DEG(att.pitch * SCALE);
+    roll_deg  = RAD2DEG(att.roll);
+    heading = ((int) RAD2DEG(att.yaw) + 360) % 360;
+
+    if ((pitch_deg == priv->pitch_deg) && (roll_deg == priv->roll_deg) &&
+                (heading == priv->heading))
+        return;
+
+    priv->pitch_deg = pitch_deg;
+    priv->roll_deg = roll_deg;
+    priv->heading = heading;
     schedule_widget(w);
 }
 
@@ -68,152 +160,100 @@ static int open(struct widget *w)
         return -1;
     w->priv = priv;
 
-    priv->cos_roll = cos(0);
-    priv->sin_roll = sin(0);
+    /* force the first geometry update */
+    priv->roll_cache = 0x7fff;
+    update_geometry(priv);
         
     w->ca.width = X_SIZE;
     w->ca.height = Y_SIZE;
-        
-    add_timer(TIMER_WIDGET, 50, pre_render, w);
+
+    /* every video field */
+    add_timer(TIMER_WIDGET, 20, pre_render, w);
     return 0;
 }
 
+static void draw_ladder_line(struct point *c, struct point *gap, struct point *size,
+                                unsigned char zero, struct canvas *ca)
+{
+    int x0 = c->x + gap->x, y0 = c->y + gap->y;
+    int x1 = x0 + size->x, y1 = y0 + size->y;
+
+    if (zero)
+        draw_line(x0-1, y0-1, x1+1, y1-1, 3, ca);
+    draw_line(x0-1, y0+1, x1+1, y1+1, 3, ca);
+    draw_line(x0, y0, x1, y1, 1, ca);
+}
+
 static void render_0(struct widget *w)
 {
     struct widget_priv *priv = w->priv;
     struct canvas *ca = &w->ca;
-    int y, i, j;
-    int x0, x1, y0, y1, offset, cx, cy;
-    unsigned char size, gap;
-    char buf[10];
-
-    for (i = -RANGE/2; i <= RANGE/2; i++) {
-        y = Y_CENTER - i;
-        //j = priv->pitch_deg*SCALE + i;
-        j = priv->pitch_deg + i;
+    struct point c, gap, size, *sz;
+    int i, j, k;
+    unsigned char n;
+
+    update_geometry(priv);
+
+    /* first ladder tick in range, then step from tick to tick */
+    if (w->slice_pos > 0) {
+        i = w->slice_pos - RANGE/2;
+    } else {
+        i = -RANGE/2;
+        j = (priv->pitch_deg + i) % LADDER_TICK;
+        if (j > 0)
+            i += LADDER_TICK - j;
+        else if (j < 0)
+            i -= j;
+    }
 
-        if (j % (MINOR_TICK*SCALE) == 0) {
-            if (j == 0) {
-                size = 40;
-                gap = 10;
-            } else {
-                if (j % (MAJOR_TICK*SCALE) == 0)
-                    size = 20;
-                else
-                    size = 10;
-                gap = 10;
-            }
-
-            cx = X_CENTER + (int) (i * priv->sin_roll);
-            cy = y + i - (int) (i * priv->cos_roll);
-
-            if ((j != 0) && (j % (MAJOR_TICK*SCALE) == 0)) {
-                sprintf(buf, "%d", j / SCALE);
-                draw_jstr(buf, cx, cy, JUST_HCENTER | JUST_VCENTER, ca, 0);
-            }
-            
-            offset = (int) gap * priv->cos_roll;
-            x0 = cx + offset;
-            offset = (int) size * priv->cos_roll;
-            x1 = x0 + offset;
-            
-            offset = (int) gap * priv->sin_roll;
-            y0 = cy + offset;
-            offset = (int) size * priv->sin_roll;
-            y1 = y0 + offset;
-            
-            if (j == 0) {
-                draw_line(x0-1, y0-1, x1+1, y1-1, 3, ca);
-                //draw_line(x0, y0-1, x1, y1-1, 1, ca);
-            }
-            draw_line(x0-1, y0+1, x1+1, y1+1, 3, ca);
-            draw_line(x0, y0, x1, y1, 1, ca);
-
-            offset = (int) gap * priv->cos_roll;
-            x0 = cx - offset;
-            offset = (int) size * priv->cos_roll;
-            x1 = x0 - offset;
-
-            offset = (int) gap * priv->sin_roll;
-            y0 = cy - offset;
-            offset = (int) size * priv->sin_roll;
-            y1 = y0 - offset;
-
-            if (j == 0) {
-                draw_line(x0-1, y0-1, x1+1, y1-1, 3, ca);
-                //draw_line(x0, y0-1, x1, y1-1, 1, ca);
-            }
-            draw_line(x0-1, y0+1, x1+1, y1+1, 3, ca);
-            draw_line(x0, y0, x1, y1, 1, ca);
+    for (; i <= RANGE/2; i += LADDER_TICK) {
+        /* resume the ladder on the next slice */
+        if (widget_slice_expired(w)) {
+            w->slice_pos = i + RANGE/2;
+            return;
+        }
+        j = priv->pitch_deg + i;
 
+        /* pitch only translates the cached geometry */
+        c.x = X_CENTER + ((i * priv->sin_q) >> GEO_SHIFT);
+        c.y = Y_CENTER - ((i * priv->cos_q) >> GEO_SHIFT);
+
+        if (j == 0) {
+            sz = &priv->size[2];
+        } else if (j % (MAJOR_TICK*SCALE) == 0) {
+            sz = &priv->size[1];
+            k = j / (MAJOR_TICK*SCALE) + LADDER_LABELS/2;
+            if ((k >= 0) && (k < LADDER_LABELS))
+                draw_jstr(ladder_labels[k], c.x, c.y, JUST_HCENTER | JUST_VCENTER, ca, 0);
+        } else {
+            sz = &priv->size[0];
         }
+
+        draw_ladder_line(&c, &priv->gap, sz, j == 0, ca);
+        gap.x = -priv->gap.x;
+        gap.y = -priv->gap.y;
+        size.x = -sz->x;
+        size.y = -sz->y;
+        draw_ladder_line(&c, &gap, &size, j == 0, ca);
     }
 
     draw_oline(X_CENTER - 3, Y_CENTER, X_CENTER + 3, Y_CENTER, 1, ca);
     draw_vline(X_CENTER, Y_CENTER - 3, Y_CENTER + 3, 1, ca);
-    
-    float cos_i, sin_i;
 
-    for (i = -ROLL_RANGE/2; i <= ROLL_RANGE/2; i++) {
-        y = Y_CENTER - i;
-        //j = priv->pitch_deg*SCALE + i;
-        //j = priv->roll_deg + i;
-
-        if (i % (MINOR_ROLL_TICK) == 0) {
-            gap = 70;
-            if (i == 0) {
-                size = 10;
-            } else {
-                if (i % (MAJOR_ROLL_TICK) == 0)
-                    size = 10;
-                else
-                    size = 5;
-            }
-
-            cos_i = cos(DEG2RAD(i));
-            sin_i = sin(DEG2RAD(i));
-            
-            cx = X_CENTER;// + (int) (gap * cos_i);
-            cy = Y_CENTER;// - (int) (gap * sin_i);
-
-
-            offset = (int) gap * cos_i;
-            x0 = cx + offset;
-            offset = (int) size * cos_i;
-            x1 = x0 + offset;
-
-
-            offset = (int) gap * sin_i;
-            y0 = cy - offset;
-            offset = (int) size * sin_i;
-            y1 = y0 - offset;
-
-            draw_line(x0, y0, x1, y1, 1, ca);
-
-            if ((i != 0) && (i % (MAJOR_ROLL_TICK) == 0)) {
-                sprintf(buf, "%d", i);
-                draw_jstr(buf, x1, y1, JUST_VCENTER, ca, 0);
-            }
-        }
+    for (n = 0; n < ROLL_TICKS; n++) {
+        draw_line(roll_scale[n].p0.x, roll_scale[n].p0.y,
+                  roll_scale[n].p1.x, roll_scale[n].p1.y, 1, ca);
+        if (roll_scale[n].label[0] != '\0')
+            draw_jstr(roll_scale[n].label, roll_scale[n].p1.x, roll_scale[n].p1.y, JUST_VCENTER, ca, 0);
     }
 
-    cx = X_CENTER; // + (int) (gap * priv->sin_roll);
-    cy = Y_CENTER ; //- (int) (gap * priv->cos_roll);
-    size = 10;
-
-    offset = (int) (gap-size) * priv->cos_roll;
-    x0 = cx + offset;
-    offset = (int) size * priv->cos_roll;
-    x1 = x0 + offset;
-
-    offset = (int) (gap-size) * priv->sin_roll;
-    y0 = cy + offset;
-    offset = (int) size * priv->sin_roll;
-    y1 = y0 + offset;
-
-    draw_line(x0-1, y0-1, x1+1, y1-1, 3, ca);
-    draw_line(x0-1, y0+1, x1+1, y1+1, 3, ca);
-    draw_line(x0, y0, x1, y1, 1, ca);
+    c.x = X_CENTER + priv->ptr0.x;
+    c.y = Y_CENTER + priv->ptr0.y;
+    i = X_CENTER + priv->ptr1.x;
+    j = Y_CENTER + priv->ptr1.y;
+    draw_line(c.x-1, c.y-1, i+1, j-1, 3, ca);
+    draw_line(c.x-1, c.y+1, i+1, j+1, 3, ca);
+    draw_line(c.x, c.y, i, j, 1, ca);
 }
 
 static void render_1(struct widget *w)
@@ -222,6 +262,8 @@ static void render_1(struct widget *w)
     struct canvas *ca = &w->ca;
     int x0, x1, y0, y1, offset, cx, cy, x, y, i;
 
+    update_geometry(priv);
+
     cx = X_SIZE / 2;
     cy = Y_CENTER;
     
@@ -297,8 +339,9 @@ void render(struct widget *w)
 const struct widget_ops horizon_widget_ops = {
     .name = "Artificial Horizon",
     .mavname = "HORIZON",
+    .prio = WIDGET_PRIO_HIGH,
     .id = WIDGET_HORIZON_ID,
-    .init = NULL,
+    .init = init,
     .open = open,
     .render = render,
     .close = NULL,
@@ -55,7 +55,8 @@ static int open(struct widget *w)
     
     
     
-    add_timer(TIMER_WIDGET, 50, pre_render, w);
+    /* every video field */
+    add_timer(TIMER_WIDGET, 20, pre_render, w);
     return 0;
 }
 
@@ -70,8 +71,7 @@ static void render(struct widget *w)
     struct home_data *home = get_home_data();
     struct flight_stats *fstats = get_flight_stats();
 
-    mavlink_attitude_t *att = mavdata_get(MAVLINK_MSG_ID_ATTITUDE);
-    mavlink_vfr_hud_t *hud = mavdata_get(MAVLINK_MSG_ID_VFR_HUD);
+    struct mavdata_attitude att;
     unsigned long d = (unsigned long) home->distance;
     unsigned int r = (w->ca.width/2)-2;
     u8 i;
@@ -86,6 +86,9 @@ static void render(struct widget *w)
     
     
     float x,y,z;
+
+    /* attitude extrapolated to now */
+    mavdata_get_attitude(&att);
     
     eye.x = 0; //X_SIZE/2;
     eye.y = 0; //Y_SIZE/2;
@@ -114,7 +117,7 @@ static void render(struct widget *w)
     draw_circle(X_SIZE/2 + p.x, Y_SIZE/2 + p.y, 5, 1, ca);
 
     
-    transform_polygon(&ils, x, z,  - (fstats->launch_heading - hud->heading));
+    transform_polygon(&ils, x, z,  - (fstats->launch_heading - (int) RAD2DEG(att.yaw)));
     for (i = 0; i < 5; i++) {
         ils_screen[i].x = (eye.z * (ils_points[i].x-eye.x)) / (eye.z + ils_points[i].y) + eye.x;
         ils_screen[i].y = (eye.z * (ls.y-eye.y)) / (eye.z + ils_points[i].y) + eye.y;
@@ -129,6 +132,7 @@ static void render(struct widget *w)
 const struct widget_ops ils_widget_ops = {
     .name = "Imaginary LS",
     .mavname = "ILS",
+    .prio = WIDGET_PRIO_HIGH,
     .id = WIDGET_ILS_ID,
     .init = NULL,
     .open = open,
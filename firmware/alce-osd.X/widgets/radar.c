@@ -19,6 +19,21 @@
 
 #include "alce-osd.h"
 
+/* flight track */
+#define TRAIL_POINTS    64
+#define TRAIL_MIN_DIST  10      /* meters, doubles every time it is thinned */
+#define TRAIL_TURN      15      /* course change (deg) that starts a new segment */
+#define TRAIL_MAX_DIST  16383   /* meters, keeps squared distances within a long */
+#define TRAIL_MAX_SHIFT 10
+
+struct trail {
+    /* offsets from home (east, north) in meters */
+    struct point pts[TRAIL_POINTS];
+    unsigned char count, shift;
+    /* course of the last segment */
+    int course;
+};
+
 struct widget_priv {
     struct home_data *home;
     struct flight_stats *stats;
@@ -26,9 +41,75 @@ struct widget_priv {
 
     int wp_target_bearing;
     unsigned int wp_distance, wp_seq;
+
+    struct trail *trail;
+
+    /* mission route, table origin from home in meters */
+    struct mission_data *mission;
+    struct point route_ofs;
+    unsigned char route;
 };
 
 
+/* straight flight only moves the tip of the track, turns add a point.
+   when full every other point is dropped and the minimum distance
+   between points doubles, so the whole flight is kept. */
+static void trail_update(struct trail *t, struct home_data *home)
+{
+    struct point p, *tip;
+    long dx, dy, min_d;
+    float x, y;
+    int course, diff;
+    unsigned char i;
+
+    if (home->lock != HOME_LOCKED) {
+        t->count = 0;
+        t->shift = 0;
+        return;
+    }
+
+    x = home->distance * sin(DEG2RAD(home->uav_bearing));
+    y = home->distance * cos(DEG2RAD(home->uav_bearing));
+    p.x = (int) TRIM(x, -TRAIL_MAX_DIST, TRAIL_MAX_DIST);
+    p.y = (int) TRIM(y, -TRAIL_MAX_DIST, TRAIL_MAX_DIST);
+
+    if (t->count == 0) {
+        t->pts[t->count++] = p;
+        return;
+    }
+
+    tip = &t->pts[t->count - 1];
+    dx = p.x - tip->x;
+    dy = p.y - tip->y;
+    min_d = (long) TRAIL_MIN_DIST << t->shift;
+    if ((dx*dx + dy*dy) < (min_d*min_d))
+        return;
+
+    course = (int) RAD2DEG(atan2(dx, dy));
+    diff = course - t->course;
+    if (diff > 180)
+        diff -= 360;
+    else if (diff < -180)
+        diff += 360;
+
+    if ((t->count > 1) && (abs(diff) < TRAIL_TURN)) {
+        *tip = p;
+        return;
+    }
+
+    if (t->count == TRAIL_POINTS) {
+        for (i = 1; i < TRAIL_POINTS/2; i++)
+            t->pts[i] = t->pts[i*2];
+        t->pts[i] = t->pts[TRAIL_POINTS - 1];
+        t->count = i + 1;
+        if (t->shift < TRAIL_MAX_SHIFT)
+            t->shift++;
+    }
+    t->pts[t->count++] = p;
+    t->course = course;
+}
+
+
 static void timer_callback(struct timer *t, void *d)
 {
     struct widget *w = d;
@@ -41,6 +122,11 @@ static void timer_callback(struct timer *t, void *d)
     priv->wp_target_bearing = nav->target_bearing;
     priv->wp_distance = nav->wp_dist;
     priv->wp_seq = mission->seq;
+
+    trail_update(priv->trail, priv->home);
+
+    priv->route = (priv->home->lock == HOME_LOCKED) && priv->mission->valid &&
+            (mission_get_offset(get_home_coord(), &priv->route_ofs) == 0);
     
     schedule_widget(w);
 }
@@ -48,6 +134,7 @@ static void timer_callback(struct timer *t, void *d)
 static int open(struct widget *w)
 {
     struct widget_priv *priv;
+    unsigned char restored;
 
     priv = (struct widget_priv*) widget_malloc(sizeof(struct widget_priv));
     if (priv == NULL)
@@ -56,6 +143,13 @@ static int open(struct widget *w)
 
     priv->home = get_home_data();
     priv->stats = get_flight_stats();
+    priv->mission = get_mission_data();
+    priv->route = 0;
+
+    /* keep the track across tab switches */
+    priv->trail = (struct trail*) widget_malloc_state(sizeof(struct trail), &restored);
+    if (priv->trail == NULL)
+        return -1;
 
     if (w->cfg->props.mode & 1) {
         w->ca.width = 84*2;
@@ -69,6 +163,64 @@ static int open(struct widget *w)
     return 0;
 }
 
+/* draw a polyline through pts, optionally ending at last. the origin
+   is the screen position of the point o (meters from home), rot is the
+   bearing pointing up */
+static void draw_track(struct point *pts, unsigned char count,
+        struct point *o, struct point *last, unsigned char color,
+        int cx, int cy, int rot, long r, long scale, struct canvas *ca)
+{
+    struct point *pt = pts;
+    long c, s, dx, dy;
+    int x0 = 0, y0 = 0, x1, y1, lim = ca->width * 2;
+    unsigned char i, valid = 0;
+
+    if (count == 0)
+        return;
+    if (last != NULL)
+        count++;
+
+    /* rotation and scale in 16.16 fixed point */
+    c = (long) (cos(DEG2RAD(rot)) * r * 65536 / scale);
+    s = (long) (sin(DEG2RAD(rot)) * r * 65536 / scale);
+
+    for (i = 0; i < count; i++, pt++) {
+        /* last segment goes to the current position */
+        if ((last != NULL) && (i == count - 1))
+            pt = last;
+        dx = pt->x - o->x;
+        dy = pt->y - o->y;
+        x1 = cx + (int) ((dx * c - dy * s) >> 16);
+        y1 = cy - (int) ((dx * s + dy * c) >> 16);
+        /* far away segments are not worth tracing */
+        if ((abs(x1) < lim) && (abs(y1) < lim)) {
+            if (valid)
+                draw_line(x0, y0, x1, y1, color, ca);
+            valid = 1;
+        } else {
+            valid = 0;
+        }
+        x0 = x1;
+        y0 = y1;
+    }
+}
+
+static void draw_trail(struct widget_priv *priv, struct point *o, struct point *uav,
+        int cx, int cy, int rot, long r, long scale, struct canvas *ca)
+{
+    struct point ro;
+
+    /* planned route under the flown track */
+    if (priv->route) {
+        ro.x = o->x - priv->route_ofs.x;
+        ro.y = o->y - priv->route_ofs.y;
+        draw_track(priv->mission->pos, priv->mission->total, &ro, NULL, 2,
+                    cx, cy, rot, r, scale, ca);
+    }
+    draw_track(priv->trail->pts, priv->trail->count, o, uav, 1,
+                    cx, cy, rot, r, scale, ca);
+}
+
 static void render(struct widget *w)
 {
     struct widget_priv *priv = w->priv;
@@ -78,7 +230,7 @@ static void render(struct widget *w)
     unsigned int r = (w->ca.width/2)-2;
     int x, y;
     int min_increment;
-    long i, scale;
+    long i, scale, scale_m;
     struct point ils_points[5] = { {-4, -6}, {-4, 6}, {0, 10}, {4, 6}, {4, -6} };
     struct polygon ils = {
         .len = 5,
@@ -91,16 +243,24 @@ static void render(struct widget *w)
     };
 
     struct polygon *p;
+    struct point uav_pos, home_pos;
 
     x = (w->ca.width/2)-1;
     y = (w->ca.height/2)-1;
 
+    if (w->slice_pos == 0) {
+        draw_vline(x, 0, r*2, 2, ca);
+        draw_hline(0, r*2, y, 2, ca);
 
-    draw_vline(x, 0, r*2, 2, ca);
-    draw_hline(0, r*2, y, 2, ca);
+        //draw_circle(x, y, r+1, 3, ca);
+        draw_circle(x, y, r  , 2, ca);
 
-    //draw_circle(x, y, r+1, 3, ca);
-    draw_circle(x, y, r  , 2, ca);
+        /* draw the rest on the next slice */
+        if (widget_slice_expired(w)) {
+            w->slice_pos = 1;
+            return;
+        }
+    }
 
 
     /* auto scale */
@@ -124,9 +284,20 @@ static void render(struct widget *w)
     i = (long) d * r;
     i /= scale;
 
+    /* uav position from home in meters */
+    uav_pos.x = (int) (priv->home->distance * sin(DEG2RAD(priv->home->uav_bearing)));
+    uav_pos.y = (int) (priv->home->distance * cos(DEG2RAD(priv->home->uav_bearing)));
+    home_pos.x = 0;
+    home_pos.y = 0;
+    /* the track is kept in meters */
+    scale_m = scale;
+    if (get_units(w->cfg) == UNITS_IMPERIAL)
+        scale_m = (long) (scale / M2FEET);
+
     switch (w->cfg->props.mode >> 1) {
         case 0:
         default:
+            draw_trail(priv, &uav_pos, &uav_pos, x, y, priv->heading, r, scale_m, ca);
             /* radar fixed at uav heading, home moves */
             x += sin(DEG2RAD(priv->home->direction)) * i;
             y -= cos(DEG2RAD(priv->home->direction)) * i;
@@ -134,6 +305,7 @@ static void render(struct widget *w)
             p = &ils;
             break;
         case 1:
+            draw_trail(priv, &home_pos, &uav_pos, x, y, 0, r, scale_m, ca);
             /* radar always facing north, uav moves */
             x += sin(DEG2RAD(priv->home->uav_bearing)) * i;
             y -= cos(DEG2RAD(priv->home->uav_bearing)) * i;
@@ -141,6 +313,7 @@ static void render(struct widget *w)
             p = &uav;
             break;
         case 2:
+            draw_trail(priv, &home_pos, &uav_pos, x, y, priv->stats->launch_heading, r, scale_m, ca);
             /* radar always facing launch direction, uav moves */
             x += sin(DEG2RAD(priv->home->uav_bearing - priv->stats->launch_heading)) * i;
             y -= cos(DEG2RAD(priv->home->uav_bearing - priv->stats->launch_heading)) * i;
@@ -150,6 +323,7 @@ static void render(struct widget *w)
         case 3:
             /* testing waypoints */
             /* radar always facing north, uav moves with waypoints */
+            draw_trail(priv, &home_pos, &uav_pos, x, y, 0, r, scale_m, ca);
             if (priv->wp_seq > 0) {
                 long i_wp = (long) priv->wp_distance * r;
                 i_wp /= scale;
@@ -25,9 +25,15 @@
 #define X_CENTER    (X_SIZE/2) + 12
 #define Y_CENTER    (Y_SIZE/2) - 1
 
+/* pre-rendered tape rows */
+#define TAPE_ROWS   (Y_SIZE*3)
+
 struct widget_priv {
     int range;
     float speed;
+    /* pre-rendered tape and the value at its first row */
+    struct canvas tape;
+    int tape_top;
 };
 
 static void render_timer(struct timer *t, void *d)
@@ -70,6 +76,9 @@ static int open(struct widget *w)
             priv->range = 20*5;
             w->ca.width = X_SIZE;
             w->ca.height = Y_SIZE;
+            priv->tape.width = X_SIZE;
+            priv->tape.height = TAPE_ROWS;
+            w->aux = &priv->tape;
             break;
         case 1:
             w->ca.width = X_SIZE_TEXT;
@@ -81,35 +90,58 @@ static int open(struct widget *w)
     return 0;
 }
 
-static void render_gauge(struct widget *w, int speed_i)
+/* ticks and labels of a tape whose first row is the value top */
+static void draw_tape(struct widget *w, struct canvas *ca, int top)
 {
     struct widget_priv *priv = w->priv;
-    struct canvas *ca = &w->ca;
-    int i, j, y = -1;
-    long yy;
-    char buf[10], d = 0;
+    int j, y, bot;
+    char buf[10];
     int major_tick = priv->range / 5;
     int minor_tick = major_tick / 4;
 
-    for (i = 0; i < priv->range; i++) {
-        yy = ((long) i * Y_SIZE) / priv->range;
-        if ((yy == y) && (d == 1))
-            continue;
-        y = Y_SIZE - (int) yy;
-        j = speed_i + i - priv->range/2;
-        if(j < 0)
-            continue;
+    bot = top - (int) (((long) ca->height * priv->range) / Y_SIZE);
+
+    /* include ticks just outside so labels are not cut */
+    j = max(bot - minor_tick, 0);
+    j -= j % minor_tick;
+    for (; j <= top + minor_tick; j += minor_tick) {
+        y = (int) (((long) (top - j) * Y_SIZE) / priv->range);
         if (j % major_tick == 0) {
             sprintf(buf, "%d", j);
             draw_jstr(buf, 2, y, JUST_VCENTER, ca, 0);
             draw_oline(X_CENTER - 2, y, X_CENTER + 4, y, 1, ca);
-            d = 1;
-        } else if (j % minor_tick == 0) {
-            draw_oline(X_CENTER - 2, y, X_CENTER + 2, y, 1, ca);
-            d = 1;
         } else {
-            d = 0;
+            draw_oline(X_CENTER - 2, y, X_CENTER + 2, y, 1, ca);
+        }
+    }
+}
+
+static inline int get_tape_row(struct widget_priv *priv, float speed)
+{
+    return (int) ((priv->tape_top - speed) * Y_SIZE / priv->range) - Y_SIZE/2;
+}
+
+static void render_gauge(struct widget *w, float speed)
+{
+    struct widget_priv *priv = w->priv;
+    struct canvas *ca = &w->ca;
+    struct canvas *tape = &priv->tape;
+    char buf[10];
+    int y, speed_i = (int) speed;
+
+    if (tape->size > 0) {
+        y = get_tape_row(priv, speed);
+        if (tape->fresh || (y < 0) || (y > (TAPE_ROWS - Y_SIZE))) {
+            /* out of the pre-rendered range, center it on the value */
+            priv->tape_top = speed_i + (int) (((long) (TAPE_ROWS/2) * priv->range) / Y_SIZE);
+            init_canvas(tape);
+            draw_tape(w, tape, priv->tape_top);
+            tape->fresh = 0;
+            y = get_tape_row(priv, speed);
         }
+        copy_canvas(ca, 0, tape, 0, y);
+    } else {
+        draw_tape(w, ca, speed_i + priv->range/2);
     }
 
     draw_frect(1, Y_CENTER-5, X_CENTER - 10, Y_CENTER + 5, 0, ca);
@@ -129,36 +161,38 @@ static void render(struct widget *w)
     struct widget_priv *priv = w->priv;
     struct canvas *ca = &w->ca;
     char buf[10], text[5];
+    float speed;
     int speed_i;
 
     switch (get_units(w->cfg)) {
         case UNITS_METRIC:
         default:
-            speed_i = (int) ((priv->speed * 3600) / 1000);
+            speed = (priv->speed * 3600) / 1000;
             strcpy(text, "km/h");
             break;
         case UNITS_IMPERIAL:
-            speed_i = (int) ((priv->speed * 3600) * M2MILE);
+            speed = (priv->speed * 3600) * M2MILE;
             strcpy(text, "mph");
             break;
         case UNITS_CUSTOM_1:
-            speed_i = (int) (priv->speed);
+            speed = priv->speed;
             strcpy(text, "m/s");
             break;
         case UNITS_CUSTOM_2:
-            speed_i = (int) (priv->speed * M2FEET);
+            speed = priv->speed * M2FEET;
             strcpy(text, "f/s");
             break;
         case UNITS_CUSTOM_3:
-            speed_i = (int) ((priv->speed * 3600 * 1.852) / 1000);
+            speed = (priv->speed * 3600 * 1.852) / 1000;
             strcpy(text, "kn");
             break;
     }
+    speed_i = (int) speed;
     
     switch (w->cfg->props.mode) {
         case 0:
         default:
-            render_gauge(w, speed_i);
+            render_gauge(w, speed);
             break;
         case 1:
             snprintf(buf, 10, "%d%s", speed_i, text);
@@ -19,8 +19,10 @@
 #include "alce-osd.h"
 
 
-#define X_SIZE  80
-#define Y_SIZE  50
+/* history strip on the left, value panel on the right */
+#define STRIP_LEN   76
+#define X_SIZE      (STRIP_LEN + 32)
+#define Y_SIZE      50
 
 
 #define CLIMBRATE_EMA 8
@@ -30,8 +32,8 @@
 struct widget_priv {
     float climb;
     int avg;
-    int hist[X_SIZE-1];
-    int y;
+    struct strip strip;
+    u8 hist[STRIP_LEN];
 };
 
 static void render_timer(struct timer *t, void *d)
@@ -39,15 +41,17 @@ static void render_timer(struct timer *t, void *d)
     struct widget *w = d;
     struct widget_priv *priv = w->priv;
     mavlink_vfr_hud_t *vfr_hud = mavdata_get(MAVLINK_MSG_ID_VFR_HUD);
+    int y;
     
     priv->climb = vfr_hud->climb * 60.0;
     priv->avg = priv->avg - (int) (((float) priv->avg - priv->climb) * ALPHA);
 
-    priv->y = -(priv->avg / SCALE) + (Y_SIZE/2)-1;
-    if (priv->y > Y_SIZE-1)
-        priv->y = Y_SIZE-1;
-    else if (priv->y < 0)
-        priv->y = 0;
+    y = -(priv->avg / SCALE) + (Y_SIZE/2)-1;
+    if (y > Y_SIZE-1)
+        y = Y_SIZE-1;
+    else if (y < 0)
+        y = 0;
+    strip_push(&priv->strip, y);
 
     schedule_widget(w);
 }
@@ -55,19 +59,17 @@ static void render_timer(struct timer *t, void *d)
 static int open(struct widget *w)
 {
     struct widget_priv *priv;
-    unsigned char i;
+    unsigned char restored;
 
-    priv = (struct widget_priv*) widget_malloc(sizeof(struct widget_priv));
+    /* keep the history across tab switches */
+    priv = (struct widget_priv*) widget_malloc_state(sizeof(struct widget_priv), &restored);
     if (priv == NULL)
         return -1;
     w->priv = priv;
 
-    for (i = 0; i < X_SIZE-1; i++)
-        priv->hist[i] = Y_SIZE/2 - 1;
-    priv->y = Y_SIZE/2 - 1;
-
     w->ca.width = X_SIZE;
     w->ca.height = Y_SIZE;
+    strip_init(&priv->strip, &w->ca, priv->hist, STRIP_LEN, Y_SIZE/2 - 1, restored);
 
     add_timer(TIMER_WIDGET, 250, render_timer, w);
     return 0;
@@ -77,22 +79,16 @@ static void render(struct widget *w)
 {
     struct widget_priv *priv = w->priv;
     struct canvas *ca = &w->ca;
-    unsigned char i;
     char buf[6];
 
-    for (i = 0; i < X_SIZE-2; i++)
-        priv->hist[i] = priv->hist[i+1];
-    priv->hist[X_SIZE-2] = priv->y;
-
-    draw_vline(X_SIZE-1, 0, Y_SIZE-1, 1, ca);
+    /* only the new samples are drawn */
+    strip_render(&priv->strip, ca);
 
-    for (i = 0; i < X_SIZE-1; i++) {
-        draw_vline(i, Y_SIZE/2-1, priv->hist[i], 2, ca);
-        set_pixel(i, priv->hist[i], 1, ca);
-    }
+    draw_frect(STRIP_LEN, 0, X_SIZE-1, Y_SIZE-1, 0, ca);
+    draw_vline(STRIP_LEN, 0, Y_SIZE-1, 1, ca);
 
-    sprintf(buf, "%4d", priv->avg);
-    draw_str(buf, X_SIZE - 6*5, 2, ca, 0);
+    sprintf(buf, "%d", priv->avg);
+    draw_jstr(buf, X_SIZE-1, 2, JUST_RIGHT | JUST_TOP, ca, 0);
 }
 
 